@@ -0,0 +1,341 @@
+// Space Tanks host benchmarks
+//
+//
+// Copyright (C) 2023 Oli Wright
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// A copy of the GNU General Public License can be found in the file
+// LICENSE.txt in the root of this project.
+// If not, see <https://www.gnu.org/licenses/>.
+//
+// oli.wright.github@gmail.com
+
+#include "benchmarks.h"
+#include "picovectorscope.h"
+#include "collisions.h"
+#include <chrono>
+#include <cmath>
+
+// The synthetic field covers the same 64x64 units as the arena, and gets
+// denser as the number of objects goes up
+static constexpr float kFieldHalfSize = 32.f;
+static constexpr uint  kNumQueries = 4096;
+// Each query is timed this many times, and the fastest run is reported
+static constexpr uint  kNumRuns = 25;
+// The number of candidates handed to Collisions::RejectRange at a time, as TestPass does
+static constexpr uint  kRejectBatchSize = 16;
+
+// Written to so the optimiser can't throw the work away
+static volatile uint s_sink;
+
+// A fixed sequence, so every run gets the same field
+class BenchmarkRandom
+{
+public:
+    float ZeroToOne()
+    {
+        m_state ^= m_state << 13;
+        m_state ^= m_state >> 17;
+        m_state ^= m_state << 5;
+        return (float) (m_state >> 8) / (float) (1u << 24);
+    }
+    float MinusOneToOne() { return (ZeroToOne() * 2.f) - 1.f; }
+
+private:
+    uint32_t m_state = 0x12345678;
+};
+
+// A collision object laid out the way Collisions stored them before the
+// spatial hash, and a linear scan over all of them, to compare against
+struct LinearCollisionObject
+{
+    CollisionTransform2D                        m_localToWorld;
+    CollisionTransform2D                        m_worldToLocal;
+    CollisionTransform2D::TranslationVectorType m_pos;
+    StandardFixedTranslationScalar              m_halfBoxWidth;
+    StandardFixedTranslationScalar              m_radius;
+    uint                                        m_mask;
+    SinTable::Index                             m_surfaceAngle;
+};
+
+static bool linearTestCircles(const LinearCollisionObject* objects,
+                              uint numObjects,
+                              const CollisionTransform2D::TranslationVectorType& pos,
+                              StandardFixedTranslationScalar radius,
+                              uint mask)
+{
+    StandardFixedTranslationScalar closestSeparationSquared = -1;
+    const LinearCollisionObject* closestObject = nullptr;
+    for(uint idx = 0; idx < numObjects; ++idx)
+    {
+        const LinearCollisionObject& object = objects[idx];
+        if((object.m_mask & mask) == 0)
+        {
+            continue;
+        }
+        const StandardFixedTranslationScalar dx = Abs(object.m_pos.x - pos.x);
+        const StandardFixedTranslationScalar dz = Abs(object.m_pos.y - pos.y);
+        const StandardFixedTranslationScalar minManhattenSeparation = (object.m_halfBoxWidth + radius) << 1;
+        if((dx + dz) > minManhattenSeparation)
+        {
+            continue;
+        }
+        const StandardFixedTranslationScalar centreDistanceSquared = ((dx * dx) + (dz * dz));
+        const StandardFixedTranslationScalar minCircleSeparation = object.m_radius + radius;
+        const StandardFixedTranslationScalar separationSquaredKinda = centreDistanceSquared - (minCircleSeparation * minCircleSeparation);
+        if((separationSquaredKinda > 0) ||
+           ((closestObject != nullptr) && (separationSquaredKinda > closestSeparationSquared)))
+        {
+            continue;
+        }
+        closestObject = &object;
+        closestSeparationSquared = separationSquaredKinda;
+    }
+    return closestObject != nullptr;
+}
+
+// The same layout as a StaticCollisionTable, sorted by bucket at runtime.
+// MakeStaticCollisionTable would do, but the compiler takes forever over
+// thousands of objects.
+template<uint N>
+struct BenchmarkCollisionTable
+{
+    CollisionObjectDef objects[N];
+    uint16_t           bucketStart[kNumCollisionBuckets + 1];
+
+    void Build(const CollisionObjectDef (&defs)[N])
+    {
+        // Counting sort
+        uint16_t bucketCount[kNumCollisionBuckets] = {};
+        for(const CollisionObjectDef& def : defs)
+        {
+            ++bucketCount[bucketOf(def)];
+        }
+        bucketStart[0] = 0;
+        for(uint bucket = 0; bucket < kNumCollisionBuckets; ++bucket)
+        {
+            bucketStart[bucket + 1] = bucketStart[bucket] + bucketCount[bucket];
+            bucketCount[bucket] = bucketStart[bucket];
+        }
+        for(const CollisionObjectDef& def : defs)
+        {
+            objects[bucketCount[bucketOf(def)]++] = def;
+        }
+    }
+
+    StaticCollisionIndex GetIndex() const
+    {
+        return StaticCollisionIndex { objects, bucketStart, N };
+    }
+
+private:
+    static uint bucketOf(const CollisionObjectDef& def)
+    {
+        return CollisionBucketIndex(CollisionCellCoord(def.shape.m_pos.x), CollisionCellCoord(def.shape.m_pos.y));
+    }
+};
+
+// The reject that the old linear scan did for each object, mask and then
+// Manhatten distance, with an early out for each.
+// Returns the number of objects that survive.
+static uint earlyOutReject(const CollisionObjectDef* objects,
+                           uint numObjects,
+                           const CollisionTransform2D::TranslationVectorType& sweepCentre,
+                           StandardFixedTranslationScalar sweepRadius,
+                           uint mask)
+{
+    uint numSurvivors = 0;
+    for(uint idx = 0; idx < numObjects; ++idx)
+    {
+        const CollisionObjectDef& object = objects[idx];
+        if((object.mask & mask) == 0)
+        {
+            continue;
+        }
+        const StandardFixedTranslationScalar dx = Abs(object.shape.m_pos.x - sweepCentre.x);
+        const StandardFixedTranslationScalar dz = Abs(object.shape.m_pos.y - sweepCentre.y);
+        const StandardFixedTranslationScalar minManhattenSeparation = (object.halfBoxWidth + sweepRadius) << 1;
+        if((dx + dz) > minManhattenSeparation)
+        {
+            continue;
+        }
+        ++numSurvivors;
+    }
+    return numSurvivors;
+}
+
+// Times a and b over kNumRuns runs each, taking turns so they both see
+// the same conditions, and keeps the fastest run of each, in nanoseconds
+// per item
+template<typename A, typename B>
+static void timeBoth(uint numItems, A a, B b, double& aNs, double& bNs)
+{
+    auto time = [numItems](auto f)
+    {
+        const auto startTime = std::chrono::steady_clock::now();
+        s_sink = f();
+        const auto endTime = std::chrono::steady_clock::now();
+        return std::chrono::duration<double, std::nano>(endTime - startTime).count() / numItems;
+    };
+    for(uint run = 0; run < kNumRuns; ++run)
+    {
+        const double runANs = time(a);
+        const double runBNs = time(b);
+        aNs = ((run == 0) || (runANs < aNs)) ? runANs : aNs;
+        bNs = ((run == 0) || (runBNs < bNs)) ? runBNs : bNs;
+    }
+}
+
+// A field of boxes at random positions and angles, stored both ways, and
+// projectile sized steps from random places in it.
+// Most of the boxes are obstacles for projectiles, and the rest only stop
+// tanks, so the mask test has something to reject.
+template<uint N>
+struct BenchmarkField
+{
+    CollisionObjectDef                    defs[N];
+    LinearCollisionObject                       linearObjects[N];
+    BenchmarkCollisionTable<N>                  table;
+    CollisionTester                             tests[kNumQueries];
+    CollisionTransform2D::TranslationVectorType testPositions[kNumQueries];
+    // The circle enclosing each step, as CollisionTester works it out
+    CollisionTransform2D::TranslationVectorType testSweepCentres[kNumQueries];
+    StandardFixedTranslationScalar              testSweepRadii[kNumQueries];
+
+    void Build()
+    {
+        BenchmarkRandom random;
+        for(uint idx = 0; idx < N; ++idx)
+        {
+            const float x = random.MinusOneToOne() * kFieldHalfSize;
+            const float z = random.MinusOneToOne() * kFieldHalfSize;
+            const float angle = random.ZeroToOne() * 6.2831853f;
+            const float halfBoxWidth = 0.25f + (random.ZeroToOne() * 1.f);
+            const uint mask = (random.ZeroToOne() < 0.75f) ? kCollisionMaskProjectileObstacle : kCollisionMaskTankObstacle;
+            const CollisionTransform2D::TranslationVectorType pos(x, z);
+            const CollisionTransform2D::OrientationVectorType axisX(cosf(angle), sinf(angle));
+            const CollisionTransform2D::OrientationVectorType axisZ(-sinf(angle), cosf(angle));
+            defs[idx] = CollisionObjectDef { CollisionShape(pos, axisX, axisZ, halfBoxWidth, 0), halfBoxWidth, mask };
+
+            LinearCollisionObject& object = linearObjects[idx];
+            object.m_localToWorld.m[0] = axisX;
+            object.m_localToWorld.m[1] = axisZ;
+            object.m_localToWorld.t = object.m_pos = pos;
+            object.m_localToWorld.orthonormalInvert(object.m_worldToLocal);
+            object.m_halfBoxWidth = halfBoxWidth;
+            object.m_radius = halfBoxWidth * 1.4142136f;
+            object.m_mask = mask;
+            object.m_surfaceAngle = 0;
+        }
+        table.Build(defs);
+
+        for(uint i = 0; i < kNumQueries; ++i)
+        {
+            const StandardFixedTranslationVector pos(random.MinusOneToOne() * kFieldHalfSize, 0, random.MinusOneToOne() * kFieldHalfSize);
+            const StandardFixedTranslationVector step(random.MinusOneToOne() * 0.05f, 0, random.MinusOneToOne() * 0.05f);
+            tests[i] = CollisionTester(pos, step, 0.1f, kCollisionMaskProjectileObstacle);
+            testPositions[i] = CollisionTransform2D::TranslationVectorType(pos.x, pos.z);
+            testSweepCentres[i] = CollisionTransform2D::TranslationVectorType(pos.x - (step.x * 0.5f), pos.z - (step.z * 0.5f));
+            testSweepRadii[i] = StandardFixedTranslationScalar(0.1f) + ((Abs(step.x) + Abs(step.z)) * 0.5f);
+        }
+    }
+};
+
+template<uint N>
+static void benchmarkSpatialHash()
+{
+    static BenchmarkField<N> s_field;
+    s_field.Build();
+    Collisions::Reset();
+    Collisions::SetStaticObjects(s_field.table.GetIndex());
+
+    uint hashHits = 0;
+    uint linearHits = 0;
+    double hashNs = 0, linearNs = 0;
+    timeBoth(kNumQueries, [&]()
+    {
+        hashHits = 0;
+        for(const CollisionTester& test : s_field.tests)
+        {
+            hashHits += Collisions::Test(test, true) ? 1 : 0;
+        }
+        return hashHits;
+    },
+    [&]()
+    {
+        linearHits = 0;
+        for(const CollisionTransform2D::TranslationVectorType& pos : s_field.testPositions)
+        {
+            linearHits += linearTestCircles(s_field.linearObjects, N, pos, 0.1f, kCollisionMaskProjectileObstacle) ? 1 : 0;
+        }
+        return linearHits;
+    },
+    hashNs, linearNs);
+    printf("%5u objects: spatial hash %8.1fns, linear scan %8.1fns per query (%.1fx), %u/%u hits\n",
+           N, hashNs, linearNs, linearNs / hashNs, hashHits, linearHits);
+}
+
+template<uint N>
+void Benchmarks::RejectPath()
+{
+    static BenchmarkField<N> s_field;
+    s_field.Build();
+
+    // Every query runs past every object, so there's no spatial hash in the
+    // way, and only the first few queries are needed to get a good time
+    constexpr uint kNumRejectQueries = (N < 512) ? kNumQueries : ((kNumQueries * 512) / N);
+    uint batchedSurvivors = 0;
+    uint earlyOutSurvivors = 0;
+    double batchedNs = 0, earlyOutNs = 0;
+    timeBoth(kNumRejectQueries * N, [&]()
+    {
+        uint16_t survivors[kRejectBatchSize];
+        batchedSurvivors = 0;
+        for(uint i = 0; i < kNumRejectQueries; ++i)
+        {
+            for(uint first = 0; first < N; first += kRejectBatchSize)
+            {
+                const uint count = ((N - first) < kRejectBatchSize) ? (N - first) : kRejectBatchSize;
+                batchedSurvivors += Collisions::RejectRange(s_field.table.objects, first, count, s_field.tests[i], survivors);
+            }
+        }
+        return batchedSurvivors;
+    },
+    [&]()
+    {
+        earlyOutSurvivors = 0;
+        for(uint i = 0; i < kNumRejectQueries; ++i)
+        {
+            earlyOutSurvivors += earlyOutReject(s_field.table.objects, N, s_field.testSweepCentres[i], s_field.testSweepRadii[i], kCollisionMaskProjectileObstacle);
+        }
+        return earlyOutSurvivors;
+    },
+    batchedNs, earlyOutNs);
+    printf("%5u objects: batched %6.2fns, early out %6.2fns per candidate (%.1fx), %u/%u survivors\n",
+           N, batchedNs, earlyOutNs, earlyOutNs / batchedNs, batchedSurvivors, earlyOutSurvivors);
+}
+
+void Benchmarks::RunSpatialHash()
+{
+    printf("Collisions::Test circles, %u queries in a %.0fx%.0f field\n", kNumQueries, kFieldHalfSize * 2.f, kFieldHalfSize * 2.f);
+    benchmarkSpatialHash<48>();
+    benchmarkSpatialHash<512>();
+    benchmarkSpatialHash<4096>();
+}
+
+void Benchmarks::RunRejectPath()
+{
+    printf("Broadphase reject, every object against each query\n");
+    RejectPath<48>();
+    RejectPath<512>();
+    RejectPath<4096>();
+}
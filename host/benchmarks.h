@@ -0,0 +1,43 @@
+// Space Tanks host benchmarks
+//
+//
+// Copyright (C) 2023 Oli Wright
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// A copy of the GNU General Public License can be found in the file
+// LICENSE.txt in the root of this project.
+// If not, see <https://www.gnu.org/licenses/>.
+//
+// oli.wright.github@gmail.com
+
+#pragma once
+#include "picovectorscope.h"
+
+// Microbenchmarks for the host runner.
+// These run on synthetic data rather than the game, so they can go to sizes
+// the game doesn't reach yet.  They leave the collision world in a mess, so
+// Simulation::Reset must be called before running the game afterwards.
+class Benchmarks
+{
+public:
+    // Collisions::Test through the spatial hash, against a linear scan of
+    // every object, for fields of 48, 512 and 4096 objects
+    static void RunSpatialHash();
+
+    // The broadphase reject as Collisions does it, a batch at a time without
+    // branching, against the old linear scan's reject with an early out for
+    // each field
+    static void RunRejectPath();
+
+private:
+    template<uint N> static void RejectPath();
+};
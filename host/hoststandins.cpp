@@ -0,0 +1,33 @@
+// Host stand-in for PicoVectorscope
+//
+//
+// Copyright (C) 2023 Oli Wright
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// A copy of the GNU General Public License can be found in the file
+// LICENSE.txt in the root of this project.
+// If not, see <https://www.gnu.org/licenses/>.
+//
+// oli.wright.github@gmail.com
+
+#include "picovectorscope.h"
+
+std::atomic<bool> Buttons::s_held[(uint) Buttons::Id::Count] = {};
+std::atomic<bool> Buttons::s_wasHeld[(uint) Buttons::Id::Count] = {};
+
+void Buttons::Update()
+{
+    for(uint i = 0; i < (uint) Id::Count; ++i)
+    {
+        s_wasHeld[i] = s_held[i].load();
+    }
+}
@@ -0,0 +1,155 @@
+// Space Tanks headless host runner
+//
+//
+// Copyright (C) 2023 Oli Wright
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// A copy of the GNU General Public License can be found in the file
+// LICENSE.txt in the root of this project.
+// If not, see <https://www.gnu.org/licenses/>.
+//
+// oli.wright.github@gmail.com
+
+#include "picovectorscope.h"
+#include "simulation.h"
+#include "collisions.h"
+#include "particles.h"
+#include "spacetanks.h"
+#include "drawstate.h"
+#include "pipeline.h"
+#include "lineofsight.h"
+#include "benchmarks.h"
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+
+// Usage: SpaceTanksHost [numFrames] [--draw] [--pipeline]
+//        SpaceTanksHost --bench
+//
+// Runs the game for numFrames frames as fast as possible, with the buttons
+// driven by a fixed script so that every run is the same.  Each frame runs
+// however many simulation ticks are due, as it would on the device.
+// --draw also renders each frame into a display list that just counts vectors.
+// --pipeline runs the simulation on another thread, a frame ahead of drawing.
+// --bench runs the microbenchmarks on synthetic data instead of the game.
+
+static constexpr uint kDefaultNumFrames = 240 * 60;
+
+// Drive round in circles, turning the other way every few seconds, and fire
+// once a second.  Fire is held for a few frames so a slower tick rate sees it.
+static void scriptButtons(uint frame)
+{
+    Buttons::Update();
+    const bool turnLeft = ((frame / 1200) & 1) == 0;
+    Buttons::SetHeld(Buttons::Id::Thrust, (frame % 2000) < 1600);
+    Buttons::SetHeld(Buttons::Id::Left, turnLeft && ((frame % 480) < 120));
+    Buttons::SetHeld(Buttons::Id::Right, !turnLeft && ((frame % 480) < 120));
+    Buttons::SetHeld(Buttons::Id::Fire, (frame % 240) < 8);
+}
+
+int main(int argc, char** argv)
+{
+    uint numFrames = kDefaultNumFrames;
+    bool draw = false;
+    bool pipeline = false;
+    for(int i = 1; i < argc; ++i)
+    {
+        if(strcmp(argv[i], "--draw") == 0)
+        {
+            draw = true;
+        }
+        else if(strcmp(argv[i], "--pipeline") == 0)
+        {
+            pipeline = true;
+        }
+        else if(strcmp(argv[i], "--bench") == 0)
+        {
+            Benchmarks::RunSpatialHash();
+            Benchmarks::RunRejectPath();
+            return 0;
+        }
+        else
+        {
+            numFrames = (uint) strtoul(argv[i], nullptr, 10);
+        }
+    }
+
+    // Same seed every time, in case anything random comes from rand()
+    srand(1);
+    Simulation::Reset();
+
+    static DrawState s_drawState;
+    DisplayList displayList;
+    uint64_t numVectors = 0;
+    const auto startTime = std::chrono::steady_clock::now();
+    const float dt = 1.f / (float) kFramesPerSecond;
+    if(pipeline)
+    {
+        Pipeline::Start();
+    }
+    for(uint frame = 0; frame < numFrames; ++frame)
+    {
+        scriptButtons(frame);
+        const DrawState* drawState = nullptr;
+        if(pipeline)
+        {
+            drawState = &Pipeline::BeginDraw();
+        }
+        else
+        {
+            Simulation::Advance(dt);
+            if(draw)
+            {
+                Simulation::Capture(s_drawState);
+                drawState = &s_drawState;
+            }
+        }
+        if(draw)
+        {
+            displayList.Clear();
+            Simulation::Draw(displayList, *drawState);
+            numVectors += displayList.GetNumVectors() + displayList.GetNumPoints();
+        }
+        if(pipeline)
+        {
+            Pipeline::EndDraw(dt);
+        }
+    }
+    Pipeline::Stop();
+    const auto endTime = std::chrono::steady_clock::now();
+
+    const double seconds = std::chrono::duration<double>(endTime - startTime).count();
+    printf("%u frames at %u ticks per second%s in %.3fs (%.0f frames/s, %.2fus per frame)\n",
+           numFrames, (uint) kTicksPerSecond.getIntegerPart(), pipeline ? ", pipelined" : "", seconds, numFrames / seconds,
+           (seconds * 1e6) / (numFrames > 0 ? numFrames : 1));
+    if(draw)
+    {
+        printf("%.1f vectors per frame\n", (double) numVectors / (numFrames > 0 ? numFrames : 1));
+        const ParticleDrawStats& drawStats = Particles::GetDrawStats();
+        printf("Last frame's particles: %u considered, %u drawn, culled %u faint, %u behind, %u outside, %u LOD, %u full\n",
+               drawStats.numConsidered, drawStats.numDrawn, drawStats.numCulledFaint,
+               drawStats.numCulledBehind, drawStats.numCulledOutside, drawStats.numCulledLOD,
+               drawStats.numCulledFull);
+    }
+    const CollisionPoolStats& poolStats = Collisions::GetPoolStats();
+    printf("Collision objects: %u static, %u/%u dynamic (high water mark %u, %u failed allocations)\n",
+           poolStats.numStaticObjects, poolStats.numAllocated, poolStats.capacity,
+           poolStats.highWaterMark, poolStats.numFailedAllocations);
+    const ParticlePoolStats& particleStats = Particles::GetPoolStats();
+    printf("Particles: %u/%u (high water mark %u, %u dropped, %u recycled)\n",
+           particleStats.numActive, particleStats.capacity, particleStats.highWaterMark,
+           particleStats.numDropped, particleStats.numRecycled);
+    const LineOfSightStats& lineOfSightStats = LineOfSight::GetStats();
+    printf("Line of sight: %u queries, %u cache hits\n", lineOfSightStats.numQueries, lineOfSightStats.numCacheHits);
+    Collisions::LogProfileSummary();
+    return 0;
+}
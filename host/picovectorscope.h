@@ -0,0 +1,108 @@
+// Host stand-in for PicoVectorscope
+//
+//
+// Copyright (C) 2023 Oli Wright
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// A copy of the GNU General Public License can be found in the file
+// LICENSE.txt in the root of this project.
+// If not, see <https://www.gnu.org/licenses/>.
+//
+// oli.wright.github@gmail.com
+
+#pragma once
+
+// This replaces PicoVectorscope's picovectorscope.h in the host build.
+// The maths comes straight from PicoVectorscope, but the display list,
+// buttons and logging are replaced with versions that just run on a desktop.
+// Keep this in step with the real header.
+#include <cstdio>
+#include <atomic>
+#include "fixedpoint.h"
+#include "sintable.h"
+#include "transform2d.h"
+#include "transform3d.h"
+
+// Doesn't draw anything. It just counts what would have been drawn.
+// The arguments are templated, because the display list's scalar, vector
+// and intensity types live with PicoVectorscope's own DisplayList, which
+// this replaces.  Anything the real one accepts is accepted here.
+class DisplayList
+{
+public:
+    template<typename X, typename Y, typename I>
+    void PushVector(const X& x, const Y& y, const I& intensity) { (void) x; (void) y; (void) intensity; ++m_numVectors; }
+    template<typename V, typename I>
+    void PushVector(const V& pos, const I& intensity) { (void) pos; (void) intensity; ++m_numVectors; }
+    template<typename X, typename Y, typename I>
+    void PushPoint(const X& x, const Y& y, const I& intensity) { (void) x; (void) y; (void) intensity; ++m_numPoints; }
+    template<typename V, typename I>
+    void PushPoint(const V& pos, const I& intensity) { (void) pos; (void) intensity; ++m_numPoints; }
+
+    void Clear() { m_numVectors = 0; m_numPoints = 0; }
+    uint GetNumVectors() const { return m_numVectors; }
+    uint GetNumPoints() const { return m_numPoints; }
+
+private:
+    uint m_numVectors = 0;
+    uint m_numPoints = 0;
+};
+
+// Buttons are driven by the host runner rather than GPIOs
+class Buttons
+{
+public:
+    enum class Id
+    {
+        Left,
+        Right,
+        Thrust,
+        Fire,
+
+        Count
+    };
+
+    static bool IsHeld(Id id) { return s_held[(uint) id]; }
+    static bool IsJustPressed(Id id) { return s_held[(uint) id] && !s_wasHeld[(uint) id]; }
+
+    // Host only
+    static void SetHeld(Id id, bool held) { s_held[(uint) id] = held; }
+    // Call once per tick, before setting the buttons for the next tick
+    static void Update();
+
+private:
+    // Atomic because the pipeline reads them from the simulation thread
+    static std::atomic<bool> s_held[(uint) Id::Count];
+    static std::atomic<bool> s_wasHeld[(uint) Id::Count];
+};
+
+// Logs go to stdout
+class LogChannel
+{
+public:
+    constexpr LogChannel(bool enabled) : m_enabled(enabled) {}
+    bool IsEnabled() const { return m_enabled; }
+
+private:
+    bool m_enabled;
+};
+#define LOG_INFO(channel, ...) do { if((channel).IsEnabled()) { printf(__VA_ARGS__); } } while(0)
+
+// There's no demo selection on the host, so this just swallows the registration
+class Demo
+{
+public:
+    Demo(int order, int targetFrameRate) { (void) order; (void) targetFrameRate; }
+    virtual ~Demo() {}
+    virtual void UpdateAndRender(DisplayList& displayList, float dt) = 0;
+    virtual void Start() {}
+};
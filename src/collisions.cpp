@@ -19,25 +19,163 @@
 // oli.wright.github@gmail.com
 
 #include "collisions.h"
+#if SPACETANKS_COLLISION_PROFILE
+#    if defined(PICO_ON_DEVICE) && PICO_ON_DEVICE
+#        include "pico/time.h"
+#    else
+#        include <chrono>
+#    endif
+#endif
 
-static constexpr uint kMaxCollisionObjects = 48;
+// The size of the dynamic object pool.
+// This can be overridden by the build for larger arenas.
+#ifndef SPACETANKS_MAX_DYNAMIC_COLLISION_OBJECTS
+#    define SPACETANKS_MAX_DYNAMIC_COLLISION_OBJECTS 8
+#endif
+static constexpr uint kMaxDynamicCollisionObjects = SPACETANKS_MAX_DYNAMIC_COLLISION_OBJECTS;
 LogChannel s_collisionLog(false);
 
-static CollisionObject s_collisionObjects[kMaxCollisionObjects] = {};
+#if SPACETANKS_COLLISION_PROFILE
+LogChannel s_collisionProfileLog(true);
+#endif
+
+static constexpr uint16_t kNullIndex = 0xffff;
+static_assert(kMaxDynamicCollisionObjects < kNullIndex, "");
+
+// The number of times Slide will try to slide along a surface before giving up
+static constexpr uint kMaxSlideIterations = 2;
+
+// The number of candidates handed to RejectRange at a time
+static constexpr uint kBatchSize = 16;
+// The number of tests that TestBatch resolves in each pass over the buckets.
+// Each test gets a bit in a uint32_t.
+static constexpr uint kMaxTestsPerPass = 32;
+
+// Scratch space for TestPass, which would otherwise be on the stack under
+// callers that have their own batches of tests there
+static uint32_t                       s_passTestColumns[kMaxTestsPerPass];
+static uint32_t                       s_passTestRows[kMaxTestsPerPass];
+static StandardFixedTranslationScalar s_passClosestKey[kMaxTestsPerPass];
+static uint16_t                       s_passSurvivors[kBatchSize];
+
+// The static objects. Empty until SetStaticObjects is called.
+static const uint16_t s_emptyBucketStart[kNumCollisionBuckets + 1] = {};
+static StaticCollisionIndex s_staticObjects = { nullptr, s_emptyBucketStart, 0 };
+
+// A bit for each bucket that any part of a static object overlaps, for each
+// mask bit that we track
+static constexpr uint kNumOccupancyMasks = 4;
+static constexpr uint kNumOccupancyWords = kNumCollisionBuckets / 32;
+static uint32_t s_staticOccupancy[kNumOccupancyMasks][kNumOccupancyWords];
+static StandardFixedTranslationScalar s_maxStaticObjectTop = 0;
+
+// The dynamic object pool.
+// Free objects are chained together through m_nextFree.
+// s_dynamicObjectsEnd is one past the highest object that has been
+// allocated since Reset, so queries don't need to visit the rest.
+static CollisionObject s_collisionObjects[kMaxDynamicCollisionObjects] = {};
+static uint16_t s_freeHead = kNullIndex;
+static uint16_t s_dynamicObjectsEnd = 0;
+static CollisionPoolStats s_poolStats;
+
+// Dynamic object data, indexed by the object's position in s_collisionObjects.
+// The mask is 0 while the object is free.
+static CollisionObjectDef s_dynamicObjects[kMaxDynamicCollisionObjects];
+
+// The dynamic objects are hashed into the same buckets as the static objects
+// once per tick, by HashDynamicObjects.  Queries read copies of them from
+// slots, which are sorted by bucket up to s_numHashedDynamicSlots.
+// An object that is configured into a different bucket after that moves to
+// a new slot on the end, and every query visits those.  The slot it left
+// gets a zero mask, so the reject skips it.
+static constexpr uint kNumDynamicSlots = 2 * kMaxDynamicCollisionObjects;
+static CollisionObjectDef s_slots[kNumDynamicSlots];
+static uint16_t           s_slotObject[kNumDynamicSlots];
+static uint16_t s_objectSlot[kMaxDynamicCollisionObjects];   //< kNullIndex if it doesn't have one
+static uint16_t s_objectBucket[kMaxDynamicCollisionObjects]; //< The bucket it was hashed into
+static uint16_t s_dynamicBucketStart[kNumCollisionBuckets + 1];
+static uint16_t s_numHashedDynamicSlots = 0;
+static uint16_t s_numDynamicSlots = 0;
+
+#if SPACETANKS_COLLISION_PROFILE
+#    define COLLISION_PROFILE(statement) statement
+// The RP2040's M0+ cores don't have a cycle counter, so time in microseconds
+static inline uint32_t profileTimeUs()
+{
+#    if defined(PICO_ON_DEVICE) && PICO_ON_DEVICE
+    return time_us_32();
+#    else
+    return (uint32_t) std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+#    endif
+}
+#else
+#    define COLLISION_PROFILE(statement)
+#endif
+
+static CollisionProfileCounters s_lastTickProfile; //< Stays at zero unless we're profiling
+
+#if SPACETANKS_COLLISION_PROFILE
+// The number of ticks between profile logs
+static constexpr uint kProfileLogInterval = 240;
+
+static CollisionProfileCounters s_tickProfile;     //< Accumulating for this tick
+static CollisionProfileCounters s_intervalProfile; //< Totals since the last log
+static CollisionProfileCounters s_totalProfile;    //< Totals since Reset
+static CollisionProfileCounters s_peakProfile;     //< Worst tick since Reset
+static uint                     s_numIntervalTicks = 0;
+static uint                     s_numProfiledTicks = 0;
+#endif
+
+static inline uint16_t objectIndex(const CollisionObject& object)
+{
+    return (uint16_t) (&object - s_collisionObjects);
+}
+
+static inline uint16_t dynamicObjectBucket(uint idx)
+{
+    const CollisionTransform2D::TranslationVectorType& pos = s_dynamicObjects[idx].shape.m_pos;
+    return (uint16_t) CollisionBucketIndex(CollisionCellCoord(pos.x), CollisionCellCoord(pos.y));
+}
 
 void CollisionObject::Configure(const FixedTransform3D& modelToWorld,
                                 StandardFixedTranslationScalar halfBoxWidth,
                                 uint mask,
                                 SinTable::Index surfaceAngle)
 {
-    m_localToWorld.m[0] = CollisionTransform2D::OrientationVectorType(modelToWorld.m[0].x, modelToWorld.m[0].z);
-    m_localToWorld.m[1] = CollisionTransform2D::OrientationVectorType(modelToWorld.m[2].x, modelToWorld.m[2].z);
-    m_localToWorld.t = m_pos = CollisionTransform2D::TranslationVectorType(modelToWorld.t.x, modelToWorld.t.z);
-    m_localToWorld.orthonormalInvert(m_worldToLocal);
-    m_mask = mask;
-    m_halfBoxWidth = halfBoxWidth;
-    m_radius = halfBoxWidth * 1.4142136f;
-    m_surfaceAngle = surfaceAngle;
+    const uint idx = objectIndex(*this);
+    const CollisionShape shape(CollisionTransform2D::TranslationVectorType(modelToWorld.t.x, modelToWorld.t.z),
+                               CollisionTransform2D::OrientationVectorType(modelToWorld.m[0].x, modelToWorld.m[0].z),
+                               CollisionTransform2D::OrientationVectorType(modelToWorld.m[2].x, modelToWorld.m[2].z),
+                               halfBoxWidth,
+                               surfaceAngle);
+    assert(shape.m_radius <= kMaxCollisionObjectRadius);
+
+    s_dynamicObjects[idx] = CollisionObjectDef { shape, halfBoxWidth, mask };
+
+    uint slot = s_objectSlot[idx];
+    if((slot == kNullIndex) || ((slot < s_numHashedDynamicSlots) && (s_objectBucket[idx] != dynamicObjectBucket(idx))))
+    {
+        // It's new since the last hash, or it has left its bucket
+        if(slot != kNullIndex)
+        {
+            s_slots[slot].mask = 0;
+        }
+        if(s_numDynamicSlots == kNumDynamicSlots)
+        {
+            // Out of slots, so hash everything again, which includes this
+            Collisions::HashDynamicObjects();
+            return;
+        }
+        slot = s_numDynamicSlots++;
+        s_objectSlot[idx] = (uint16_t) slot;
+        s_slotObject[slot] = (uint16_t) idx;
+    }
+    s_slots[slot] = s_dynamicObjects[idx];
+}
+
+uint CollisionObject::GetMask() const
+{
+    return s_dynamicObjects[objectIndex(*this)].mask;
 }
 
 CollisionTester::CollisionTester(const StandardFixedTranslationVector& pos,
@@ -48,172 +186,664 @@ CollisionTester::CollisionTester(const StandardFixedTranslationVector& pos,
 , m_deltaPos(CollisionTransform2D::TranslationVectorType(deltaPos.x, deltaPos.z))
 , m_radius(radius)
 , m_mask(mask)
-{}
+, m_ignoreObject(nullptr)
+, m_height(0)
+{
+    // Half the Manhatten length of the step is at least half its actual length,
+    // so this circle encloses the whole sweep
+    m_sweepCentre = m_pos - (m_deltaPos * 0.5f);
+    m_sweepRadius = m_radius + ((Abs(m_deltaPos.x) + Abs(m_deltaPos.y)) * 0.5f);
+}
 
 void Collisions::Reset()
 {
-    for(CollisionObject& object : s_collisionObjects)
+    s_staticObjects = StaticCollisionIndex { nullptr, s_emptyBucketStart, 0 };
+    s_maxStaticObjectTop = 0;
+    for(auto& occupancy : s_staticOccupancy)
+    {
+        for(uint32_t& word : occupancy)
+        {
+            word = 0;
+        }
+    }
+
+    // Put all the dynamic objects on the free list, in order
+    for(uint idx = 0; idx < kMaxDynamicCollisionObjects; ++idx)
     {
-        object.m_mask = 0;
+        s_collisionObjects[idx].m_nextFree = (idx + 1 < kMaxDynamicCollisionObjects) ? (uint16_t) (idx + 1) : kNullIndex;
     }
+    for(CollisionObjectDef& object : s_dynamicObjects)
+    {
+        object.mask = 0;
+    }
+    for(uint16_t& slot : s_objectSlot)
+    {
+        slot = kNullIndex;
+    }
+    for(uint16_t& start : s_dynamicBucketStart)
+    {
+        start = 0;
+    }
+    s_numHashedDynamicSlots = 0;
+    s_numDynamicSlots = 0;
+    s_freeHead = (kMaxDynamicCollisionObjects > 0) ? 0 : kNullIndex;
+    s_dynamicObjectsEnd = 0;
+    s_poolStats = CollisionPoolStats();
+    s_poolStats.capacity = kMaxDynamicCollisionObjects;
+
+    s_lastTickProfile = CollisionProfileCounters();
+#if SPACETANKS_COLLISION_PROFILE
+    s_tickProfile = CollisionProfileCounters();
+    s_intervalProfile = CollisionProfileCounters();
+    s_totalProfile = CollisionProfileCounters();
+    s_peakProfile = CollisionProfileCounters();
+    s_numIntervalTicks = 0;
+    s_numProfiledTicks = 0;
+#endif
 }
 
-CollisionObject& Collisions::AllocateObject()
+void Collisions::SetStaticObjects(const StaticCollisionIndex& index)
 {
-    for(CollisionObject& object : s_collisionObjects)
+    s_staticObjects = index;
+
+    // Mark every bucket that each object's bounding square touches
+    for(uint idx = 0; idx < index.numObjects; ++idx)
     {
-        if(object.m_mask == 0)
+        const CollisionObjectDef& object = index.objects[idx];
+        if(object.shape.m_top > s_maxStaticObjectTop)
         {
-            object.m_mask = 0x1000; //< Just make it non-zero until it gets configured
-            return object;
+            s_maxStaticObjectTop = object.shape.m_top;
+        }
+        const StandardFixedTranslationScalar radius = object.shape.m_radius;
+        const int cellX0 = CollisionCellCoord(object.shape.m_pos.x - radius);
+        const int cellX1 = CollisionCellCoord(object.shape.m_pos.x + radius);
+        const int cellZ0 = CollisionCellCoord(object.shape.m_pos.y - radius);
+        const int cellZ1 = CollisionCellCoord(object.shape.m_pos.y + radius);
+        for(int cellZ = cellZ0; cellZ <= cellZ1; ++cellZ)
+        {
+            for(int cellX = cellX0; cellX <= cellX1; ++cellX)
+            {
+                const uint bucket = CollisionBucketIndex(cellX, cellZ);
+                for(uint maskBit = 0; maskBit < kNumOccupancyMasks; ++maskBit)
+                {
+                    if(object.mask & (1u << maskBit))
+                    {
+                        s_staticOccupancy[maskBit][bucket >> 5] |= 1u << (bucket & 31);
+                    }
+                }
+            }
         }
     }
-    // We've run out of collision objects
-    assert(false);
-    return *(CollisionObject*)nullptr;
+    s_poolStats.numStaticObjects = index.numObjects;
+}
+
+StandardFixedTranslationScalar Collisions::GetMaxStaticObjectTop()
+{
+    return s_maxStaticObjectTop;
+}
+
+void Collisions::HashDynamicObjects()
+{
+    // Counting sort by bucket.  Count into the starts, then turn the counts
+    // into starts.
+    for(uint16_t& start : s_dynamicBucketStart)
+    {
+        start = 0;
+    }
+    for(uint idx = 0; idx < s_dynamicObjectsEnd; ++idx)
+    {
+        if(s_dynamicObjects[idx].mask != 0)
+        {
+            s_objectBucket[idx] = dynamicObjectBucket(idx);
+            ++s_dynamicBucketStart[s_objectBucket[idx]];
+        }
+        s_objectSlot[idx] = kNullIndex;
+    }
+    uint16_t numSlots = 0;
+    for(uint bucket = 0; bucket < kNumCollisionBuckets; ++bucket)
+    {
+        const uint16_t count = s_dynamicBucketStart[bucket];
+        s_dynamicBucketStart[bucket] = numSlots;
+        numSlots += count;
+    }
+    s_dynamicBucketStart[kNumCollisionBuckets] = numSlots;
+
+    for(uint idx = 0; idx < s_dynamicObjectsEnd; ++idx)
+    {
+        if(s_dynamicObjects[idx].mask != 0)
+        {
+            const uint slot = s_dynamicBucketStart[s_objectBucket[idx]]++;
+            s_objectSlot[idx] = (uint16_t) slot;
+            s_slotObject[slot] = (uint16_t) idx;
+            s_slots[slot] = s_dynamicObjects[idx];
+        }
+    }
+    // Each start has moved up to where the next bucket starts, so move them back
+    for(uint bucket = kNumCollisionBuckets; bucket > 0; --bucket)
+    {
+        s_dynamicBucketStart[bucket] = s_dynamicBucketStart[bucket - 1];
+    }
+    s_dynamicBucketStart[0] = 0;
+
+    s_numHashedDynamicSlots = numSlots;
+    s_numDynamicSlots = numSlots;
+}
+
+bool Collisions::MayHitStaticObject(StandardFixedTranslationScalar x, StandardFixedTranslationScalar z, uint mask)
+{
+    const uint bucket = CollisionBucketIndex(CollisionCellCoord(x), CollisionCellCoord(z));
+    const uint32_t bit = 1u << (bucket & 31);
+    bool mayHit = false;
+    for(uint maskBit = 0; maskBit < kNumOccupancyMasks; ++maskBit)
+    {
+        mayHit |= ((mask & (1u << maskBit)) != 0) && ((s_staticOccupancy[maskBit][bucket >> 5] & bit) != 0);
+    }
+    return mayHit;
+}
+
+CollisionObject* Collisions::AllocateObject()
+{
+    if(s_freeHead == kNullIndex)
+    {
+        // We've run out of collision objects
+        ++s_poolStats.numFailedAllocations;
+        LOG_INFO(s_collisionLog, "Out of dynamic collision objects (%d)\n", kMaxDynamicCollisionObjects);
+        return nullptr;
+    }
+    const uint16_t idx = s_freeHead;
+    CollisionObject& object = s_collisionObjects[idx];
+    s_freeHead = object.m_nextFree;
+    s_dynamicObjects[idx].mask = kCollisionMaskInert; //< Until it gets configured
+    if(idx >= s_dynamicObjectsEnd)
+    {
+        s_dynamicObjectsEnd = idx + 1;
+    }
+
+    if(++s_poolStats.numAllocated > s_poolStats.highWaterMark)
+    {
+        s_poolStats.highWaterMark = s_poolStats.numAllocated;
+    }
+    return &object;
 }
 
 void Collisions::FreeObject(CollisionObject& object)
 {
-    object.m_mask = 0;
+    const uint16_t idx = objectIndex(object);
+    assert((idx < kMaxDynamicCollisionObjects) && (s_dynamicObjects[idx].mask != 0));
+    if(s_dynamicObjects[idx].mask == 0)
+    {
+        // Already free, most likely reclaimed by Reset.  Pushing it again
+        // would link the free list into a loop.
+        return;
+    }
+    s_dynamicObjects[idx].mask = 0;
+    if(s_objectSlot[idx] != kNullIndex)
+    {
+        s_slots[s_objectSlot[idx]].mask = 0;
+        s_objectSlot[idx] = kNullIndex;
+    }
+    object.m_nextFree = s_freeHead;
+    s_freeHead = idx;
+    --s_poolStats.numAllocated;
+}
+
+const CollisionPoolStats& Collisions::GetPoolStats()
+{
+    return s_poolStats;
+}
+
+uint Collisions::RejectRange(const CollisionObjectDef* objects,
+                             uint first,
+                             uint count,
+                             const CollisionTester& test,
+                             uint16_t* outSurvivors)
+{
+    // Reject on mask and Manhatten distance without branching, writing every
+    // candidate to the output and only advancing past the ones that survive.
+    // We use the circle enclosing the whole step, so this is safe for swept tests.
+    const StandardFixedTranslationScalar testX = test.m_sweepCentre.x;
+    const StandardFixedTranslationScalar testZ = test.m_sweepCentre.y;
+    const StandardFixedTranslationScalar testRadius = test.m_sweepRadius;
+    const uint testMask = test.m_mask;
+    uint numSurvivors = 0;
+    const uint end = first + count;
+    COLLISION_PROFILE(s_tickProfile.numObjectsVisited += count);
+    for(uint idx = first; idx < end; ++idx)
+    {
+        const CollisionObjectDef& object = objects[idx];
+        const StandardFixedTranslationScalar dx = Abs(object.shape.m_pos.x - testX);
+        const StandardFixedTranslationScalar dz = Abs(object.shape.m_pos.y - testZ);
+        const StandardFixedTranslationScalar minManhattenSeparation = (object.halfBoxWidth + testRadius) << 1;
+        const bool maskOk = ((object.mask & testMask) != 0);
+        const bool distanceOk = ((dx + dz) <= minManhattenSeparation);
+        const bool survives = maskOk & distanceOk;
+        COLLISION_PROFILE(s_tickProfile.numMaskRejects += (uint) !maskOk);
+        COLLISION_PROFILE(s_tickProfile.numDistanceRejects += (uint) (maskOk & !distanceOk));
+        outSurvivors[numSurvivors] = (uint16_t) idx;
+        numSurvivors += (uint) survives;
+    }
+    return numSurvivors;
+}
+
+// Clip the segment start + (delta * t), for t in [tEnter, tExit], against the
+// slab -halfWidth <= x <= halfWidth.
+// Returns false if the segment misses the slab.
+// If the segment enters the slab later than tEnter, tEnter is moved up and
+// enterAxis is set to axis.
+static bool clipSlab(StandardFixedTranslationScalar start,
+                     StandardFixedTranslationScalar delta,
+                     StandardFixedTranslationScalar halfWidth,
+                     int axis,
+                     StandardFixedTranslationScalar& tEnter,
+                     StandardFixedTranslationScalar& tExit,
+                     int& enterAxis)
+{
+    // Work with a +ve delta, so we always enter through -halfWidth and leave through +halfWidth
+    if(delta < 0)
+    {
+        start = -start;
+        delta = -delta;
+    }
+    if((start > halfWidth) || ((start + delta) < -halfWidth))
+    {
+        // Already past the slab, or doesn't reach it this step.
+        // This also covers a zero delta outside the slab.
+        return false;
+    }
+    // We only divide when we know the result is in [0, 1], so it can't overflow
+    if(start < -halfWidth)
+    {
+        const StandardFixedTranslationScalar t = (-halfWidth - start) / delta;
+        if(t > tEnter)
+        {
+            tEnter = t;
+            enterAxis = axis;
+        }
+    }
+    if((start + delta) > halfWidth)
+    {
+        const StandardFixedTranslationScalar t = (halfWidth - start) / delta;
+        if(t < tExit)
+        {
+            tExit = t;
+        }
+    }
+    return true;
+}
+
+void Collisions::TestObject(const CollisionObjectDef* objects,
+                            uint idx,
+                            const CollisionObject* object,
+                            const CollisionTester& test,
+                            bool justDoCircles,
+                            CollisionInfo& collisionInfo,
+                            StandardFixedTranslationScalar& closestKey)
+{
+    // RejectRange has already checked the mask and the Manhatten distance,
+    // so we know it's safe to square these without overflowing.
+    // Circle tests use the end position, but the box test is swept so we use
+    // a circle that encloses the whole step.
+    if((object != nullptr) && (object == test.m_ignoreObject))
+    {
+        return;
+    }
+    const CollisionShape& shape = objects[idx].shape;
+    if(shape.m_top <= test.m_height)
+    {
+        // Passes over the top
+        return;
+    }
+    const CollisionTransform2D::TranslationVectorType& circlePos = justDoCircles ? test.m_pos : test.m_sweepCentre;
+    const StandardFixedTranslationScalar circleRadius = justDoCircles ? test.m_radius : test.m_sweepRadius;
+    const StandardFixedTranslationScalar dx = Abs(shape.m_pos.x - circlePos.x);
+    const StandardFixedTranslationScalar dz = Abs(shape.m_pos.y - circlePos.y);
+    const StandardFixedTranslationScalar centreDistanceSquared = ((dx * dx) + (dz * dz));
+    const StandardFixedTranslationScalar minCircleSeparation = shape.m_radius + circleRadius;
+    const StandardFixedTranslationScalar separationSquaredKinda = centreDistanceSquared - (minCircleSeparation * minCircleSeparation);
+    if(separationSquaredKinda > 0)
+    {
+        // Not overlapping
+        COLLISION_PROFILE(++s_tickProfile.numCircleRejects);
+        return;
+    }
+    if(justDoCircles)
+    {
+        if((collisionInfo.mask != 0) && (separationSquaredKinda > closestKey))
+        {
+            // Overlapping, but not the closest
+            return;
+        }
+        // Overlappingest so far
+        collisionInfo.mask = objects[idx].mask;
+        collisionInfo.object = object;
+        closestKey = separationSquaredKinda;
+        return;
+    }
+
+    COLLISION_PROFILE(++s_tickProfile.numBoxTests);
+
+    // Sweep the test circle against the box.
+    // To do this, we transform the start of the step and the step itself
+    // into the space of the collision object.
+    // Sweeping a circle against a box is the same as sweeping a point against
+    // the box expanded by the radius. We expand it to a square rather than
+    // rounding the corners, which errs on the side of a hit by at most
+    // radius * (sqrt(2) - 1) at the corners.
+    CollisionTransform2D::TranslationVectorType startPosInObjectSpace;
+    CollisionTransform2D::TranslationVectorType deltaPosInObjectSpace;
+    shape.WorldToLocal(startPosInObjectSpace, test.m_pos - test.m_deltaPos);
+    shape.RotateWorldToLocal(deltaPosInObjectSpace, test.m_deltaPos);
+    const StandardFixedTranslationScalar halfBoxWidth = objects[idx].halfBoxWidth;
+    const StandardFixedTranslationScalar extendedHalfBoxWidth = halfBoxWidth + test.m_radius;
+    LOG_INFO(s_collisionLog, "---\nStartPos: %f, %f\n", (float) startPosInObjectSpace.x, (float) startPosInObjectSpace.y);
+    LOG_INFO(s_collisionLog, "DeltaPos: %f, %f\n", (float) deltaPosInObjectSpace.x, (float) deltaPosInObjectSpace.y);
+
+    StandardFixedTranslationScalar tEnter = 0;
+    StandardFixedTranslationScalar tExit = 1.f;
+    int enterAxis = -1;
+    if(!clipSlab(startPosInObjectSpace.x, deltaPosInObjectSpace.x, extendedHalfBoxWidth, 0, tEnter, tExit, enterAxis) ||
+       !clipSlab(startPosInObjectSpace.y, deltaPosInObjectSpace.y, extendedHalfBoxWidth, 1, tEnter, tExit, enterAxis) ||
+       (tEnter > tExit))
+    {
+        return;
+    }
+    if((collisionInfo.mask != 0) && (tEnter >= closestKey))
+    {
+        // Hit, but something else gets hit first
+        return;
+    }
+
+    CollisionTransform2D::TranslationVectorType hitPosLocal = startPosInObjectSpace + (deltaPosInObjectSpace * tEnter);
+    if(enterAxis < 0)
+    {
+        // We started inside the box, so push out through the nearest face
+        enterAxis = ((extendedHalfBoxWidth - Abs(hitPosLocal.x)) < (extendedHalfBoxWidth - Abs(hitPosLocal.y))) ? 0 : 1;
+    }
+    LOG_INFO(s_collisionLog, "Hit: %f, axis %d\n", (float) tEnter, enterAxis);
+
+    // Report the contact point on the surface of the box, rather than the
+    // centre of the test circle
+    CollisionTransform2D::OrientationVectorType hitNormalLocal;
+    SinTableValue surfaceSin = 0, surfaceCos = 1;
+    if(shape.m_surfaceAngle != 0)
+    {
+        SinTable::SinCos(shape.m_surfaceAngle, surfaceSin, surfaceCos);
+    }
+    if(enterAxis == 0)
+    {
+        const bool negative = (hitPosLocal.x < 0);
+        hitPosLocal.x = negative ? -halfBoxWidth : halfBoxWidth;
+        hitNormalLocal = CollisionTransform2D::OrientationVectorType(negative ? -surfaceCos : surfaceCos, 0);
+    }
+    else
+    {
+        const bool negative = (hitPosLocal.y < 0);
+        hitPosLocal.y = negative ? -halfBoxWidth : halfBoxWidth;
+        hitNormalLocal = CollisionTransform2D::OrientationVectorType(0, negative ? -surfaceCos : surfaceCos);
+    }
+    CollisionTransform2D::TranslationVectorType pos;
+    CollisionTransform2D::OrientationVectorType normal;
+    shape.LocalToWorld(pos, hitPosLocal);
+    shape.RotateLocalToWorld(normal, hitNormalLocal);
+    collisionInfo.pos = StandardFixedTranslationVector(pos.x, 0, pos.y);
+    collisionInfo.normal = StandardFixedOrientationVector(normal.x, surfaceSin, normal.y);
+    collisionInfo.timeOfImpact = tEnter;
+    collisionInfo.mask = objects[idx].mask;
+    collisionInfo.object = object;
+
+    // Earliest hit so far
+    closestKey = tEnter;
 }
 
 const bool Collisions::Test(const CollisionTester& test, bool justDoCircles, CollisionInfo* outCollisionInfo)
 {
-    StandardFixedTranslationScalar closestSeparationSquared = -1;
-    const CollisionObject* closestObject = nullptr;
-    for(const CollisionObject& object : s_collisionObjects)
-    {
-        if((object.m_mask & test.m_mask) != 0)
-        {
-            // Test the distance of this object pair to see if they overlap
-            const StandardFixedTranslationScalar dx = Abs(object.m_pos.x - test.m_pos.x);
-            const StandardFixedTranslationScalar dz = Abs(object.m_pos.y - test.m_pos.y);
-            const StandardFixedTranslationScalar minManhattenSeparation = (object.m_halfBoxWidth + test.m_radius) << 1;
-            // First we'll consider the Manhatten distance. Both as an early-out
-            // and also to prevent us from trying to square large numbers which
-            // might overflow
-            StandardFixedTranslationScalar manhattenDistance = dx + dz;
-            if(manhattenDistance > minManhattenSeparation)
+    CollisionInfo collisionInfo;
+    CollisionInfo& info = (outCollisionInfo != nullptr) ? *outCollisionInfo : collisionInfo;
+    TestBatch(&test, 1, justDoCircles, &info);
+    return info.mask != 0;
+}
+
+uint Collisions::TestBatch(const CollisionTester* tests,
+                           uint numTests,
+                           bool justDoCircles,
+                           CollisionInfo* outCollisionInfos)
+{
+    COLLISION_PROFILE(const uint32_t startTimeUs = profileTimeUs());
+    uint numHits = 0;
+    for(uint first = 0; first < numTests; first += kMaxTestsPerPass)
+    {
+        const uint numTestsInPass = ((numTests - first) < kMaxTestsPerPass) ? (numTests - first) : kMaxTestsPerPass;
+        numHits += TestPass(tests + first, numTestsInPass, justDoCircles, outCollisionInfos + first);
+    }
+    COLLISION_PROFILE(++s_tickProfile.numQueries);
+    COLLISION_PROFILE(s_tickProfile.numTests += numTests);
+    COLLISION_PROFILE(s_tickProfile.numHits += numHits);
+    COLLISION_PROFILE(s_tickProfile.timeUs += profileTimeUs() - startTimeUs);
+    return numHits;
+}
+
+// Returns a bit for each column (or row) of buckets that the cell range [cell0, cell1] touches
+static uint32_t bucketAxisBits(int cell0, int cell1)
+{
+    if((cell1 - cell0) >= (int) kCollisionBucketsPerAxis)
+    {
+        return (1ull << kCollisionBucketsPerAxis) - 1;
+    }
+    uint32_t bits = 0;
+    for(int cell = cell0; cell <= cell1; ++cell)
+    {
+        bits |= 1u << ((uint) cell & (kCollisionBucketsPerAxis - 1));
+    }
+    return bits;
+}
+
+uint Collisions::TestPass(const CollisionTester* tests,
+                          uint numTests,
+                          bool justDoCircles,
+                          CollisionInfo* outCollisionInfos)
+{
+    // Find the buckets that each test's swept circle can overlap.
+    // Objects live in the cell containing their centre, so expand by the largest object radius.
+    // A bucket is overlapped by a test if both its column and row bits are set.
+    uint32_t allColumns = 0;
+    uint32_t allRows = 0;
+    for(uint i = 0; i < numTests; ++i)
+    {
+        const CollisionTester& test = tests[i];
+        const CollisionTransform2D::TranslationVectorType prevPos = test.m_pos - test.m_deltaPos;
+        const StandardFixedTranslationScalar expand = test.m_radius + kMaxCollisionObjectRadius;
+        const int cellX0 = CollisionCellCoord(((prevPos.x < test.m_pos.x) ? prevPos.x : test.m_pos.x) - expand);
+        const int cellX1 = CollisionCellCoord(((prevPos.x < test.m_pos.x) ? test.m_pos.x : prevPos.x) + expand);
+        const int cellZ0 = CollisionCellCoord(((prevPos.y < test.m_pos.y) ? prevPos.y : test.m_pos.y) - expand);
+        const int cellZ1 = CollisionCellCoord(((prevPos.y < test.m_pos.y) ? test.m_pos.y : prevPos.y) + expand);
+        s_passTestColumns[i] = bucketAxisBits(cellX0, cellX1);
+        s_passTestRows[i] = bucketAxisBits(cellZ0, cellZ1);
+        allColumns |= s_passTestColumns[i];
+        allRows |= s_passTestRows[i];
+        s_passClosestKey[i] = -1;
+        outCollisionInfos[i].mask = 0;
+        outCollisionInfos[i].object = nullptr;
+    }
+
+    // Run a contiguous range of objects past a set of tests, a batch at a time.
+    // Each batch is run past every test while it's still warm in the cache.
+    auto testRange = [&](const CollisionObjectDef* objects, const uint16_t* slotObjects, uint first, uint end, uint32_t rangeTests)
+    {
+        for(uint batch = first; batch < end; batch += kBatchSize)
+        {
+            const uint count = ((end - batch) < kBatchSize) ? (end - batch) : kBatchSize;
+            for(uint i = 0; i < numTests; ++i)
             {
-                // Can't be overlapping
-                continue;
+                if((rangeTests & (1u << i)) == 0)
+                {
+                    continue;
+                }
+                const uint numSurvivors = RejectRange(objects, batch, count, tests[i], s_passSurvivors);
+                for(uint j = 0; j < numSurvivors; ++j)
+                {
+                    const CollisionObject* object = (slotObjects != nullptr) ? &s_collisionObjects[slotObjects[s_passSurvivors[j]]] : nullptr;
+                    TestObject(objects, s_passSurvivors[j], object, tests[i], justDoCircles, outCollisionInfos[i], s_passClosestKey[i]);
+                }
             }
-            const StandardFixedTranslationScalar centreDistanceSquared = ((dx * dx) + (dz * dz));
-            const StandardFixedTranslationScalar minCircleSeparation = object.m_radius + test.m_radius;
-            const StandardFixedTranslationScalar separationSquaredKinda = centreDistanceSquared - (minCircleSeparation * minCircleSeparation);
-            if(separationSquaredKinda > 0)
+        }
+    };
+
+    // Walk each bucket that any test overlaps just once
+    for(uint row = 0; row < kCollisionBucketsPerAxis; ++row)
+    {
+        if((allRows & (1u << row)) == 0)
+        {
+            continue;
+        }
+        for(uint column = 0; column < kCollisionBucketsPerAxis; ++column)
+        {
+            if((allColumns & (1u << column)) == 0)
             {
-                // Not overlapping
                 continue;
             }
-            if(justDoCircles)
+            const uint bucket = column + (row * kCollisionBucketsPerAxis);
+            const uint first = s_staticObjects.bucketStart[bucket];
+            const uint end = s_staticObjects.bucketStart[bucket + 1];
+            const uint dynamicFirst = s_dynamicBucketStart[bucket];
+            const uint dynamicEnd = s_dynamicBucketStart[bucket + 1];
+            if((first == end) && (dynamicFirst == dynamicEnd))
             {
-                if((closestObject != nullptr) && (separationSquaredKinda > closestSeparationSquared))
-                {
-                    // Overlapping, but not the closest
-                    continue;
-                }
+                continue;
             }
-            else
+            uint32_t bucketTests = 0;
+            for(uint i = 0; i < numTests; ++i)
             {
-                // Test the box.
-                // To do this, we must transform the test point into the space of
-                // the collision object.
-                CollisionTransform2D::TranslationVectorType testPosInObjectSpace;
-                object.m_worldToLocal.transformVector(testPosInObjectSpace, test.m_pos);
-                StandardFixedTranslationScalar extendedHalfBoxWidth = object.m_halfBoxWidth + test.m_radius;
-                LOG_INFO(s_collisionLog, "---\nTestPos: %f, %f\n", (float) testPosInObjectSpace.x, (float) testPosInObjectSpace.y);
-                if((Abs(testPosInObjectSpace.x) > extendedHalfBoxWidth) || (Abs(testPosInObjectSpace.y) > extendedHalfBoxWidth))
-                {
-                    continue;
-                }
-
-                if(outCollisionInfo != nullptr)
-                {
-                    // Now we look at the deltas and figure out which side of the box we've crossed
-                    CollisionTransform2D::TranslationVectorType testDeltaPosInObjectSpace;
-                    object.m_worldToLocal.rotateVector(testDeltaPosInObjectSpace, test.m_deltaPos);
-                    // We want to work with -ve deltas, and +ve edges
-                    bool flipX = false;
-                    bool flipY = false;
-                    if(testDeltaPosInObjectSpace.x > 0)
-                    {
-                        flipX = true;
-                        testDeltaPosInObjectSpace.x = -testDeltaPosInObjectSpace.x;
-                        testPosInObjectSpace.x = -testPosInObjectSpace.x;
-                    }
-                    if(testDeltaPosInObjectSpace.y > 0)
-                    {
-                        flipY = true;
-                        testDeltaPosInObjectSpace.y = -testDeltaPosInObjectSpace.y;
-                        testPosInObjectSpace.y = -testPosInObjectSpace.y;
-                    }
-                    LOG_INFO(s_collisionLog, "Flip: %d, %d\n", flipX, flipY);
-                    const StandardFixedTranslationScalar shrunkHalfBoxWidth = object.m_halfBoxWidth;// - test.m_radius;
-                    const CollisionTransform2D::TranslationVectorType testPreviousPosInObjectSpace = testPosInObjectSpace - testDeltaPosInObjectSpace;
-                    LOG_INFO(s_collisionLog, "TestPos: %f, %f\n", (float) testPosInObjectSpace.x, (float) testPosInObjectSpace.y);
-                    LOG_INFO(s_collisionLog, "PrevPos: %f, %f\n", (float) testPreviousPosInObjectSpace.x, (float) testPreviousPosInObjectSpace.y);
-
-                    const bool crossedX = (testPosInObjectSpace.x < shrunkHalfBoxWidth) && (testPreviousPosInObjectSpace.x >= shrunkHalfBoxWidth);
-                    const bool crossedY = (testPosInObjectSpace.y < shrunkHalfBoxWidth) && (testPreviousPosInObjectSpace.y >= shrunkHalfBoxWidth);
-                    if(!crossedX && !crossedY)
-                    {
-                        continue; // Precision?
-                    }
-                    StandardFixedTranslationScalar xt = 0;
-                    StandardFixedTranslationScalar yt = 0;
-                    if(crossedX)
-                    {
-                        xt = (shrunkHalfBoxWidth - testPosInObjectSpace.x) / (testPreviousPosInObjectSpace.x - testPosInObjectSpace.x);
-                    }
-                    if(crossedY)
-                    {
-                        yt = (shrunkHalfBoxWidth - testPosInObjectSpace.y) / (testPreviousPosInObjectSpace.y - testPosInObjectSpace.y);
-                    }
-                    CollisionTransform2D::TranslationVectorType hitPosLocal;
-                    CollisionTransform2D::OrientationVectorType hitNormalLocal;
-                    SinTableValue surfaceSin = 0, surfaceCos = 1;
-                    if(object.m_surfaceAngle != 0)
-                    {
-                        SinTable::SinCos(object.m_surfaceAngle, surfaceSin, surfaceCos);
-                    }
-                    if(xt > yt)
-                    {
-                        // Hit the x
-                        hitPosLocal = testPreviousPosInObjectSpace + (testDeltaPosInObjectSpace * xt);
-                        hitNormalLocal = CollisionTransform2D::OrientationVectorType(surfaceCos, 0);
-                    }
-                    else
-                    {
-                        // Hit the y
-                        hitPosLocal = testPreviousPosInObjectSpace + (testDeltaPosInObjectSpace * yt);
-                        hitNormalLocal = CollisionTransform2D::OrientationVectorType(0, surfaceCos);
-                    }
-                    if(flipX)
-                    {
-                        hitPosLocal.x = -hitPosLocal.x;
-                        hitNormalLocal.x = -hitNormalLocal.x;
-                    }
-                    if(flipY)
-                    {
-                        hitPosLocal.y = -hitPosLocal.y;
-                        hitNormalLocal.y = -hitNormalLocal.y;
-                    }
-                    CollisionTransform2D::TranslationVectorType pos;
-                    CollisionTransform2D::OrientationVectorType normal;                    
-                    object.m_localToWorld.transformVector(pos, hitPosLocal);
-                    object.m_localToWorld.rotateVector(normal, hitNormalLocal);
-                    outCollisionInfo->pos = StandardFixedTranslationVector(pos.x, 0, pos.y);
-                    outCollisionInfo->normal = StandardFixedOrientationVector(normal.x, surfaceSin, normal.y);
-                    outCollisionInfo->object = &object;
-                }
+                const bool overlaps = ((s_passTestColumns[i] & (1u << column)) != 0) && ((s_passTestRows[i] & (1u << row)) != 0);
+                bucketTests |= (uint32_t) overlaps << i;
             }
+            testRange(s_staticObjects.objects, nullptr, first, end, bucketTests);
+            testRange(s_slots, s_slotObject, dynamicFirst, dynamicEnd, bucketTests);
+        }
+    }
+
+    // Every test visits the dynamic objects that have changed bucket since they were hashed
+    testRange(s_slots, s_slotObject, s_numHashedDynamicSlots, s_numDynamicSlots, (numTests == kMaxTestsPerPass) ? 0xffffffffu : ((1u << numTests) - 1));
 
-            // Overlappingest so far
-            closestObject = &object;
-            closestSeparationSquared = separationSquaredKinda;
+    uint numHits = 0;
+    for(uint i = 0; i < numTests; ++i)
+    {
+        numHits += (outCollisionInfos[i].mask != 0) ? 1 : 0;
+    }
+    return numHits;
+}
+
+StandardFixedTranslationVector Collisions::Slide(const StandardFixedTranslationVector& pos,
+                                                 const StandardFixedTranslationVector& deltaPos,
+                                                 StandardFixedTranslationScalar radius,
+                                                 uint mask,
+                                                 const CollisionObject* ignoreObject)
+{
+    StandardFixedTranslationVector start = pos;
+    StandardFixedTranslationVector step = deltaPos;
+    for(uint iteration = 0; iteration < kMaxSlideIterations; ++iteration)
+    {
+        CollisionTester test(start + step, step, radius, mask);
+        test.SetIgnoreObject(ignoreObject);
+
+        // Most of the time there's nothing nearby, and the circle test is a
+        // lot cheaper than sweeping against the boxes
+        if(!Test(test, true))
+        {
+            return start + step;
         }
+        CollisionInfo collisionInfo;
+        if(!Test(test, false, &collisionInfo))
+        {
+            return start + step;
+        }
+
+        // Move up to the point of contact
+        const StandardFixedTranslationVector travelled = step * collisionInfo.timeOfImpact;
+        start += travelled;
+        step -= travelled;
+
+        // Then take out the part of the remaining step that goes into the surface.
+        // Sloped surfaces have a shorter normal on the XZ plane, so we divide
+        // by its squared length rather than assuming it's 1.
+        const StandardFixedTranslationScalar normalX = (StandardFixedTranslationScalar) collisionInfo.normal.x;
+        const StandardFixedTranslationScalar normalZ = (StandardFixedTranslationScalar) collisionInfo.normal.z;
+        const StandardFixedTranslationScalar into = (step.x * normalX) + (step.z * normalZ);
+        if(into >= 0)
+        {
+            // Already heading out, which happens if we started inside the box
+            return start + step;
+        }
+        const StandardFixedTranslationScalar scale = into / ((normalX * normalX) + (normalZ * normalZ));
+        step.x -= normalX * scale;
+        step.z -= normalZ * scale;
+    }
+    // Still blocked, so stay at the last point of contact
+    return start;
+}
+
+#if SPACETANKS_COLLISION_PROFILE
+// Apply op to each counter of a and b
+template<typename Op>
+static void forEachCounter(CollisionProfileCounters& a, const CollisionProfileCounters& b, Op op)
+{
+    op(a.numQueries, b.numQueries);
+    op(a.numTests, b.numTests);
+    op(a.numObjectsVisited, b.numObjectsVisited);
+    op(a.numMaskRejects, b.numMaskRejects);
+    op(a.numDistanceRejects, b.numDistanceRejects);
+    op(a.numCircleRejects, b.numCircleRejects);
+    op(a.numBoxTests, b.numBoxTests);
+    op(a.numHits, b.numHits);
+    op(a.timeUs, b.timeUs);
+}
+
+static void logProfile(const char* title, const CollisionProfileCounters& total, uint numTicks, const CollisionProfileCounters& peak)
+{
+    // Averages per tick are in tenths, so we don't need floats
+    const uint n = (numTicks > 0) ? numTicks : 1;
+    LOG_INFO(s_collisionProfileLog, "%s: %d ticks, average (peak) per tick\n", title, numTicks);
+    LOG_INFO(s_collisionProfileLog, "  queries %d.%d (%d), tests %d.%d (%d), hits %d.%d (%d)\n",
+             total.numQueries / n, (total.numQueries * 10 / n) % 10, peak.numQueries,
+             total.numTests / n, (total.numTests * 10 / n) % 10, peak.numTests,
+             total.numHits / n, (total.numHits * 10 / n) % 10, peak.numHits);
+    LOG_INFO(s_collisionProfileLog, "  visited %d.%d (%d), mask rejects %d.%d, distance rejects %d.%d\n",
+             total.numObjectsVisited / n, (total.numObjectsVisited * 10 / n) % 10, peak.numObjectsVisited,
+             total.numMaskRejects / n, (total.numMaskRejects * 10 / n) % 10,
+             total.numDistanceRejects / n, (total.numDistanceRejects * 10 / n) % 10);
+    LOG_INFO(s_collisionProfileLog, "  circle rejects %d.%d, box tests %d.%d (%d), time %dus (%dus)\n",
+             total.numCircleRejects / n, (total.numCircleRejects * 10 / n) % 10,
+             total.numBoxTests / n, (total.numBoxTests * 10 / n) % 10, peak.numBoxTests,
+             total.timeUs / n, peak.timeUs);
+}
+#endif
+
+void Collisions::EndProfileTick()
+{
+#if SPACETANKS_COLLISION_PROFILE
+    s_lastTickProfile = s_tickProfile;
+    forEachCounter(s_intervalProfile, s_tickProfile, [](auto& a, auto b) { a += b; });
+    forEachCounter(s_totalProfile, s_tickProfile, [](auto& a, auto b) { a += b; });
+    forEachCounter(s_peakProfile, s_tickProfile, [](auto& a, auto b) { if(b > a) a = b; });
+    s_tickProfile = CollisionProfileCounters();
+    ++s_numProfiledTicks;
+
+    if(++s_numIntervalTicks == kProfileLogInterval)
+    {
+        logProfile("Collisions", s_intervalProfile, s_numIntervalTicks, s_peakProfile);
+        s_intervalProfile = CollisionProfileCounters();
+        s_numIntervalTicks = 0;
     }
-    return closestObject;
+#endif
 }
+
+const CollisionProfileCounters& Collisions::GetLastTickProfile()
+{
+    return s_lastTickProfile;
+}
+
+void Collisions::LogProfileSummary()
+{
+#if SPACETANKS_COLLISION_PROFILE
+    logProfile("Collision summary", s_totalProfile, s_numProfiledTicks, s_peakProfile);
+#endif
+}
\ No newline at end of file
@@ -21,16 +21,123 @@
 #pragma once
 #include "picovectorscope.h"
 #include "transform3d.h"
+#include <utility>
 
 static constexpr uint kCollisionMaskProjectileObstacle = (1u << 0);
 static constexpr uint kCollisionMaskTankObstacle       = (1u << 1);
 static constexpr uint kCollisionMaskPlayer             = (1u << 2);
 static constexpr uint kCollisionMaskEnemy              = (1u << 3);
+// Allocated objects that shouldn't collide with anything, such as dead tanks.
+// Testers never ask for this bit, and it keeps the mask non-zero, because zero means free.
+static constexpr uint kCollisionMaskInert              = (1u << 12);
 
 // Collisions take place on a 2D plane
 // So we define a 2D transform using the same precision types as our 3D transforms
 typedef Transform2D<StandardFixedOrientationScalar,StandardFixedTranslationScalar> CollisionTransform2D;
 
+// Static objects are indexed by a spatial hash on the XZ plane.
+// The plane is divided into square cells, and the cells wrap onto a fixed
+// grid of buckets, so we don't need to know the extents of the world.
+// Objects are placed in the cell containing their centre, so queries need
+// to be expanded by the largest object radius.
+static constexpr uint kCollisionBucketsPerAxis = 16; // Must be a power of 2, and no more than 32
+static constexpr uint kNumCollisionBuckets = kCollisionBucketsPerAxis * kCollisionBucketsPerAxis;
+static constexpr StandardFixedTranslationScalar kCollisionCellSize = 4.f;
+static constexpr StandardFixedTranslationScalar kRecipCollisionCellSize = 1.f / (float) kCollisionCellSize;
+static constexpr StandardFixedTranslationScalar kMaxCollisionObjectRadius = 2.f;
+// The height of the top of an object that doesn't say how tall it is
+static constexpr StandardFixedTranslationScalar kUnboundedCollisionObjectTop = 1024.f;
+static_assert((kCollisionBucketsPerAxis & (kCollisionBucketsPerAxis - 1)) == 0, "");
+static_assert(kCollisionBucketsPerAxis <= 32, "");
+
+constexpr int CollisionCellCoord(StandardFixedTranslationScalar v)
+{
+    return (v * kRecipCollisionCellSize).getIntegerPart();
+}
+
+constexpr uint CollisionBucketIndex(int cellX, int cellZ)
+{
+    return ((uint) cellX & (kCollisionBucketsPerAxis - 1)) | (((uint) cellZ & (kCollisionBucketsPerAxis - 1)) * kCollisionBucketsPerAxis);
+}
+
+// The parts of a collision object that are only needed once it has survived
+// the broadphase.
+// The local axes double as the rows of the world-to-local rotation, so
+// nothing ever needs inverting, and shapes can be built at compile-time.
+struct CollisionShape
+{
+    CollisionTransform2D::OrientationVectorType m_axisX; //< Local x axis in world space
+    CollisionTransform2D::OrientationVectorType m_axisZ; //< Local z axis in world space
+    CollisionTransform2D::TranslationVectorType m_pos;
+    StandardFixedTranslationScalar              m_radius;
+    SinTable::Index                             m_surfaceAngle;
+    StandardFixedTranslationScalar              m_top; //< Height of the top, for testers that set a height
+
+    constexpr CollisionShape()
+    : m_axisX(1.f, 0.f)
+    , m_axisZ(0.f, 1.f)
+    , m_pos(0.f, 0.f)
+    , m_radius(0.f)
+    , m_surfaceAngle(0.f)
+    , m_top(kUnboundedCollisionObjectTop)
+    {}
+
+    constexpr CollisionShape(const CollisionTransform2D::TranslationVectorType& pos,
+                             const CollisionTransform2D::OrientationVectorType& axisX,
+                             const CollisionTransform2D::OrientationVectorType& axisZ,
+                             StandardFixedTranslationScalar halfBoxWidth,
+                             SinTable::Index surfaceAngle,
+                             StandardFixedTranslationScalar top = kUnboundedCollisionObjectTop)
+    : m_axisX(axisX)
+    , m_axisZ(axisZ)
+    , m_pos(pos)
+    , m_radius(halfBoxWidth * 1.4142136f)
+    , m_surfaceAngle(surfaceAngle)
+    , m_top(top)
+    {}
+
+    void WorldToLocal(CollisionTransform2D::TranslationVectorType& out, const CollisionTransform2D::TranslationVectorType& in) const
+    {
+        RotateWorldToLocal(out, in - m_pos);
+    }
+    void RotateWorldToLocal(CollisionTransform2D::TranslationVectorType& out, const CollisionTransform2D::TranslationVectorType& in) const
+    {
+        out.x = (in.x * m_axisX.x) + (in.y * m_axisX.y);
+        out.y = (in.x * m_axisZ.x) + (in.y * m_axisZ.y);
+    }
+    void LocalToWorld(CollisionTransform2D::TranslationVectorType& out, const CollisionTransform2D::TranslationVectorType& in) const
+    {
+        out.x = m_pos.x + (in.x * m_axisX.x) + (in.y * m_axisZ.x);
+        out.y = m_pos.y + (in.x * m_axisX.y) + (in.y * m_axisZ.y);
+    }
+    void RotateLocalToWorld(CollisionTransform2D::OrientationVectorType& out, const CollisionTransform2D::OrientationVectorType& in) const
+    {
+        out.x = (in.x * m_axisX.x) + (in.y * m_axisZ.x);
+        out.y = (in.x * m_axisX.y) + (in.y * m_axisZ.y);
+    }
+};
+
+// A collision object's shape, with the half box width and mask that the
+// broadphase needs.  This is how Collisions stores both kinds of object,
+// and how static objects are described to MakeStaticCollisionTable.
+struct CollisionObjectDef
+{
+    CollisionShape                 shape;
+    StandardFixedTranslationScalar halfBoxWidth;
+    uint                           mask;
+};
+
+// Static objects, sorted by bucket.
+// The objects in bucket b are [bucketStart[b], bucketStart[b + 1])
+struct StaticCollisionIndex
+{
+    const CollisionObjectDef* objects;
+    const uint16_t*           bucketStart;
+    uint                      numObjects;
+};
+
+// A dynamic collision object.
+// This is just a handle. Its data lives in arrays owned by Collisions.
 class CollisionObject
 {
 public:
@@ -39,16 +146,11 @@ public:
                    uint mask,
                    SinTable::Index surfaceAngle = 0);
 
-    uint GetMask() const { return m_mask; }
+    uint GetMask() const;
 
 private:
-    CollisionTransform2D                        m_localToWorld;
-    CollisionTransform2D                        m_worldToLocal;
-    CollisionTransform2D::TranslationVectorType m_pos;
-    StandardFixedTranslationScalar              m_halfBoxWidth;
-    StandardFixedTranslationScalar              m_radius;
-    uint                                        m_mask;
-    SinTable::Index                             m_surfaceAngle;
+    // Next object in the free list, while this is free
+    uint16_t m_nextFree;
 
     friend class Collisions;
 };
@@ -56,15 +158,30 @@ private:
 class CollisionTester
 {
 public:
+    CollisionTester() {}
     CollisionTester(const StandardFixedTranslationVector& pos,
                     const StandardFixedTranslationVector& deltaPos,
                     StandardFixedTranslationScalar radius,
                     uint mask);
+
+    // Don't collide with this object, so a tank doesn't collide with itself
+    void SetIgnoreObject(const CollisionObject* object) { m_ignoreObject = object; }
+
+    // Only collide with objects whose tops are above this height.
+    // Objects are extruded up from the ground, so this is how something
+    // small, like a particle, passes over the lower ones.
+    void SetHeight(StandardFixedTranslationScalar height) { m_height = height; }
+
 private:
     CollisionTransform2D::TranslationVectorType m_pos;
     CollisionTransform2D::TranslationVectorType m_deltaPos;
     StandardFixedTranslationScalar              m_radius;
     uint                                        m_mask;
+    // A circle that encloses the whole step, for the broadphase
+    CollisionTransform2D::TranslationVectorType m_sweepCentre;
+    StandardFixedTranslationScalar              m_sweepRadius;
+    const CollisionObject*                      m_ignoreObject;
+    StandardFixedTranslationScalar              m_height;
 
     friend class Collisions;
 };
@@ -73,22 +190,220 @@ struct CollisionInfo
 {
     StandardFixedTranslationVector pos;
     StandardFixedOrientationVector normal;
+    // How far through the step the hit happened, from 0 to 1
+    StandardFixedTranslationScalar timeOfImpact;
+    // The mask of the object that was hit, or 0 if nothing was hit
+    uint                           mask;
+    // The dynamic object that was hit, or nullptr if it was a static object
     const CollisionObject*         object;
 };
 
+struct CollisionPoolStats
+{
+    uint numStaticObjects     = 0;
+    // The rest are for the dynamic object pool
+    uint capacity             = 0;
+    uint numAllocated         = 0;
+    uint highWaterMark        = 0; //< Most objects allocated at once since Reset
+    uint numFailedAllocations = 0;
+};
+
+// Collision query profiling.
+// Build with SPACETANKS_COLLISION_PROFILE=1 to turn it on. Otherwise the
+// counters stay at zero and cost nothing.
+#ifndef SPACETANKS_COLLISION_PROFILE
+#    define SPACETANKS_COLLISION_PROFILE 0
+#endif
+
+struct CollisionProfileCounters
+{
+    uint     numQueries         = 0; //< Calls to TestBatch, including via Test
+    uint     numTests           = 0;
+    uint     numObjectsVisited  = 0; //< Candidates handed to the broadphase reject
+    uint     numMaskRejects     = 0;
+    uint     numDistanceRejects = 0; //< Manhatten distance
+    uint     numCircleRejects   = 0;
+    uint     numBoxTests        = 0;
+    uint     numHits            = 0;
+    uint32_t timeUs             = 0; //< Time spent in TestBatch
+};
+
 // Static class to manage collision detection
+//
+// There are two kinds of collision object.
+// Static objects never move. They live in a StaticCollisionIndex, which is
+// sorted by spatial hash bucket so queries only visit the buckets they
+// overlap. The index is normally built at compile-time by
+// MakeStaticCollisionTable, so it costs no RAM and no startup time.
+// Dynamic objects are allocated from a small pool and can be reconfigured
+// every tick. They're hashed into the same buckets once per tick, and the
+// few that change bucket before the next hash are visited by every query.
 class Collisions
 {
 public:    
     static void Reset();
-    static CollisionObject& AllocateObject();
+
+    // Set the static objects.  The index must outlive the collision world.
+    static void SetStaticObjects(const StaticCollisionIndex& index);
+
+    // A coarse test for whether a point on the XZ plane could be inside any
+    // static object with a common mask bit.
+    // This only looks at a bitmap of spatial hash buckets, so it's cheap
+    // enough to run on lots of points before doing any real tests.
+    static bool MayHitStaticObject(StandardFixedTranslationScalar x, StandardFixedTranslationScalar z, uint mask);
+
+    // The height of the top of the tallest static object
+    static StandardFixedTranslationScalar GetMaxStaticObjectTop();
+
+    // Hash the dynamic objects into buckets.
+    // Call this once per tick, before the collision queries.
+    static void HashDynamicObjects();
+
+    // Allocate a dynamic object.
+    // Returns nullptr if the pool is exhausted
+    static CollisionObject* AllocateObject();
     static void FreeObject(CollisionObject& object);
+    static const CollisionPoolStats& GetPoolStats();
 
     // Test for a collision.
     // Only collision objects with at least one common mask bit with the test
     // object will be tested.
+    // If justDoCircles is true, the circle at the end of the step is tested
+    // against each object's bounding circle, and the most overlapping object wins.
+    // Otherwise, the circle is swept along the step against each object's box,
+    // and the earliest hit wins.
     // Returns true if there was a collision, false otherwise.
     // If outCollisionInfo is not nullptr, it will be populated with information
     // about the collision.
     static const bool Test(const CollisionTester& test, bool justDoCircles, CollisionInfo* outCollisionInfo = nullptr);
-};
\ No newline at end of file
+
+    // Test several objects in one pass over the collision world.
+    // outCollisionInfos must have an entry for every test, and each entry's
+    // mask will be 0 if that test didn't collide with anything.
+    // Returns the number of tests that collided.
+    static uint TestBatch(const CollisionTester* tests,
+                          uint numTests,
+                          bool justDoCircles,
+                          CollisionInfo* outCollisionInfos);
+
+    // Move a circle from pos by deltaPos, sliding along any boxes with a
+    // common mask bit that get in the way.
+    // Returns the new position.
+    static StandardFixedTranslationVector Slide(const StandardFixedTranslationVector& pos,
+                                                const StandardFixedTranslationVector& deltaPos,
+                                                StandardFixedTranslationScalar radius,
+                                                uint mask,
+                                                const CollisionObject* ignoreObject = nullptr);
+
+    // Profiling. These do nothing unless SPACETANKS_COLLISION_PROFILE is set.
+    // Call EndProfileTick once per tick, after all the collision queries.
+    // It logs a summary every second.
+    static void EndProfileTick();
+    static const CollisionProfileCounters& GetLastTickProfile();
+    // Log averages and peaks over every tick since Reset
+    static void LogProfileSummary();
+
+private:
+    // So the host build can time the reject path on its own
+    friend class Benchmarks;
+
+    static uint TestPass(const CollisionTester* tests,
+                         uint numTests,
+                         bool justDoCircles,
+                         CollisionInfo* outCollisionInfos);
+    static uint RejectRange(const CollisionObjectDef* objects,
+                            uint first,
+                            uint count,
+                            const CollisionTester& test,
+                            uint16_t* outSurvivors);
+    static void TestObject(const CollisionObjectDef* objects,
+                           uint idx,
+                           const CollisionObject* object,
+                           const CollisionTester& test,
+                           bool justDoCircles,
+                           CollisionInfo& collisionInfo,
+                           StandardFixedTranslationScalar& closestKey);
+};
+
+// Storage for a StaticCollisionIndex
+template<uint N>
+struct StaticCollisionTable
+{
+    CollisionObjectDef objects[N];
+    uint16_t           bucketStart[kNumCollisionBuckets + 1];
+
+    constexpr StaticCollisionIndex GetIndex() const
+    {
+        return StaticCollisionIndex { objects, bucketStart, N };
+    }
+};
+
+// Builds a StaticCollisionTable at compile-time.
+// This is all O(N^2), which is fine because it's the compiler's time, not ours.
+template<uint N>
+class StaticCollisionTableBuilder
+{
+public:
+    static constexpr StaticCollisionTable<N> Build(const CollisionObjectDef (&defs)[N])
+    {
+        return Build(defs, SortByBucket(defs), std::make_index_sequence<N>(), std::make_index_sequence<kNumCollisionBuckets + 1>());
+    }
+
+private:
+    struct Order
+    {
+        uint16_t idx[N];
+    };
+
+    static constexpr uint Bucket(const CollisionObjectDef& def)
+    {
+        return CollisionBucketIndex(CollisionCellCoord(def.shape.m_pos.x), CollisionCellCoord(def.shape.m_pos.y));
+    }
+
+    static constexpr Order SortByBucket(const CollisionObjectDef (&defs)[N])
+    {
+        // Each object goes after all the objects in lower buckets, and after
+        // the objects before it in the same bucket
+        Order order {};
+        for(uint i = 0; i < N; ++i)
+        {
+            const uint bucket = Bucket(defs[i]);
+            uint rank = 0;
+            for(uint j = 0; j < N; ++j)
+            {
+                const uint otherBucket = Bucket(defs[j]);
+                rank += ((otherBucket < bucket) || ((otherBucket == bucket) && (j < i))) ? 1 : 0;
+            }
+            order.idx[rank] = (uint16_t) i;
+        }
+        return order;
+    }
+
+    static constexpr uint16_t BucketStart(const CollisionObjectDef (&defs)[N], uint bucket)
+    {
+        uint16_t start = 0;
+        for(uint i = 0; i < N; ++i)
+        {
+            start += (Bucket(defs[i]) < bucket) ? 1 : 0;
+        }
+        return start;
+    }
+
+    template<size_t... Is, size_t... Bs>
+    static constexpr StaticCollisionTable<N> Build(const CollisionObjectDef (&defs)[N],
+                                                   const Order& order,
+                                                   std::index_sequence<Is...>,
+                                                   std::index_sequence<Bs...>)
+    {
+        return StaticCollisionTable<N> {
+            { defs[order.idx[Is]]... },
+            { BucketStart(defs, (uint) Bs)... },
+        };
+    }
+};
+
+template<uint N>
+constexpr StaticCollisionTable<N> MakeStaticCollisionTable(const CollisionObjectDef (&defs)[N])
+{
+    return StaticCollisionTableBuilder<N>::Build(defs);
+}
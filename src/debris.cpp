@@ -0,0 +1,176 @@
+// Space Tanks debris
+//
+//
+// Copyright (C) 2023 Oli Wright
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// A copy of the GNU General Public License can be found in the file
+// LICENSE.txt in the root of this project.
+// If not, see <https://www.gnu.org/licenses/>.
+//
+// oli.wright.github@gmail.com
+
+#include "debris.h"
+#include "particles.h"
+#include "shapes.h"
+#include "spacetanks.h"
+#include "enemytanks.h"
+#include "maths.h"
+#include "simulation.h"
+#include "drawstate.h"
+
+// Chunks spin at one of a fixed set of rates, which are worked out once in
+// Reset, so throwing out a chunk doesn't need to build a rotation
+static constexpr uint kNumSpins = 16;
+// Applying the spin every tick lets rounding errors creep in, so each chunk
+// tidies up its transform this often
+static constexpr uint kReorthonormaliseInterval = 64;
+
+static FixedTransform3D s_spins[kNumSpins];
+
+static void normalise(StandardFixedOrientationVector& vec)
+{
+    StandardFixedOrientationScalar length = ((vec.x * vec.x) + (vec.y * vec.y) + (vec.z * vec.z)).sqrt();
+    StandardFixedOrientationScalar recipLength = length.recip();
+    vec *= recipLength;
+}
+
+// A single chunk of debris
+class DebrisChunk : public ParticleBase
+{
+public:
+    DebrisChunk() : ParticleBase()
+    , m_shape(FixedShape::Chunk0)
+    {}
+
+    void Activate(const StandardFixedTranslationVector& pos,
+                  const StandardFixedTranslationVector& velocity,
+                  FixedShape shape,
+                  uint spin,
+                  uint ticksUntilReorthonormalise)
+    {
+        // Between a quarter of a second and a second, with the longer lived ones brighter
+        const StandardFixedTranslationScalar relLife = StandardFixedTranslationScalar::randZeroToOne() * 0.75f + 0.25f;
+        ParticleBase::Activate(pos, velocity, (uint) (relLife * kTicksPerSecond), relLife * 0.3f);
+
+        m_shape = shape;
+        m_spin = (uint8_t) spin;
+        m_ticksUntilReorthonormalise = (uint8_t) ticksUntilReorthonormalise;
+        m_modelToWorld.setAsIdentity();
+        m_modelToWorld.markAsManuallyManipulated();
+        m_modelToWorld.setTranslation(pos);
+    }
+
+    void Update()
+    {
+        ParticleBase::Update();
+        if(!IsActive())
+        {
+            return;
+        }
+        m_modelToWorld *= s_spins[m_spin];
+        m_modelToWorld.t = m_pos;
+        if(--m_ticksUntilReorthonormalise == 0)
+        {
+            Reorthonormalise();
+            m_ticksUntilReorthonormalise = kReorthonormaliseInterval;
+        }
+    }
+
+    void Capture(DrawState& drawState) const
+    {
+        // Back up to between the last two ticks
+        FixedTransform3D modelToWorld = m_modelToWorld;
+        modelToWorld.t -= m_velocity * (StandardFixedTranslationScalar(1.f) - Simulation::GetTickFraction());
+        drawState.PushShape(m_shape, modelToWorld, m_intrinsicBrightness * 3.f);
+    }
+
+private:
+    // Gram-Schmidt, keeping the x axis
+    void Reorthonormalise()
+    {
+        normalise(m_modelToWorld.m[0]);
+        m_modelToWorld.m[2] = cross(m_modelToWorld.m[0], m_modelToWorld.m[1]);
+        normalise(m_modelToWorld.m[2]);
+        m_modelToWorld.m[1] = cross(m_modelToWorld.m[2], m_modelToWorld.m[0]);
+    }
+
+    FixedTransform3D m_modelToWorld;
+    FixedShape       m_shape;
+    uint8_t          m_spin;
+    uint8_t          m_ticksUntilReorthonormalise;
+};
+
+// The live chunks are packed into [0, s_numActiveChunks)
+static DebrisChunk s_chunks[kMaxDebrisChunks];
+static uint        s_numActiveChunks = 0;
+// Chunks take the spins in turn, which also spreads their tidy-ups across different ticks
+static uint        s_nextSpin = 0;
+
+void Debris::Reset()
+{
+    s_numActiveChunks = 0;
+    s_nextSpin = 0;
+    for(FixedTransform3D& spin : s_spins)
+    {
+        StandardFixedOrientationVector rotationAngles;
+        static const float kMaxRadsPerSecond = 0.2f;
+        rotationAngles.x = StandardFixedTranslationScalar::randMinusOneToOne() * kMaxRadsPerSecond * kPerSecondMultiplier;
+        rotationAngles.y = StandardFixedTranslationScalar::randMinusOneToOne() * kMaxRadsPerSecond * kPerSecondMultiplier;
+        rotationAngles.z = StandardFixedTranslationScalar::randMinusOneToOne() * kMaxRadsPerSecond * kPerSecondMultiplier;
+        spin.setRotationXYZ(rotationAngles.x, rotationAngles.y, rotationAngles.z);
+        spin.setTranslation(StandardFixedTranslationVector(0, 0, 0));
+    }
+}
+
+void Debris::Update()
+{
+    uint idx = 0;
+    while(idx < s_numActiveChunks)
+    {
+        DebrisChunk& chunk = s_chunks[idx];
+        chunk.Update();
+        if(!chunk.IsActive())
+        {
+            // Replace it with the last live one, and don't advance
+            chunk = s_chunks[--s_numActiveChunks];
+            continue;
+        }
+        ++idx;
+    }
+}
+
+void Debris::Capture(DrawState& drawState)
+{
+    for(uint idx = 0; idx < s_numActiveChunks; ++idx)
+    {
+        s_chunks[idx].Capture(drawState);
+    }
+}
+
+void Debris::Explode(const StandardFixedTranslationVector& pos)
+{
+    for(uint i = 0; (i < kNumDebrisChunkShapes) && (s_numActiveChunks < kMaxDebrisChunks); ++i)
+    {
+        StandardFixedTranslationVector velocity;
+        velocity.x = StandardFixedTranslationScalar::randMinusOneToOne();
+        velocity.y = StandardFixedTranslationScalar::randZeroToOne();
+        velocity.z = StandardFixedTranslationScalar::randMinusOneToOne();
+        velocity *= kPerSecondMultiplier * 5.f;
+        const uint spin = s_nextSpin++ & (kNumSpins - 1);
+        s_chunks[s_numActiveChunks++].Activate(pos,
+                                              velocity,
+                                              (FixedShape) ((int) FixedShape::Chunk0 + i),
+                                              spin,
+                                              1 + ((spin * kReorthonormaliseInterval) / kNumSpins));
+    }
+}
@@ -0,0 +1,49 @@
+// Space Tanks debris
+//
+//
+// Copyright (C) 2023 Oli Wright
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// A copy of the GNU General Public License can be found in the file
+// LICENSE.txt in the root of this project.
+// If not, see <https://www.gnu.org/licenses/>.
+//
+// oli.wright.github@gmail.com
+
+#pragma once
+#include "picovectorscope.h"
+#include "extras/camera.h"
+#include "enemytanks.h"
+
+struct DrawState;
+
+// Each explosion throws out one chunk of each shape
+static constexpr uint kNumDebrisChunkShapes = 5;
+
+// The size of the debris pool.
+// This can be overridden by the build.
+#ifndef SPACETANKS_MAX_DEBRIS_CHUNKS
+#    define SPACETANKS_MAX_DEBRIS_CHUNKS (kNumDebrisChunkShapes * kMaxEnemyTanks)
+#endif
+static constexpr uint kMaxDebrisChunks = SPACETANKS_MAX_DEBRIS_CHUNKS;
+
+// Static class to manage _all_ the chunks of debris from exploding things
+class Debris
+{
+public:
+    static void Reset();
+    static void Update();
+    static void Capture(DrawState& drawState);
+
+    // Throw out one chunk of each shape from pos
+    static void Explode(const StandardFixedTranslationVector& pos);
+};
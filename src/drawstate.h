@@ -0,0 +1,115 @@
+// Space Tanks draw state
+//
+//
+// Copyright (C) 2023 Oli Wright
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// A copy of the GNU General Public License can be found in the file
+// LICENSE.txt in the root of this project.
+// If not, see <https://www.gnu.org/licenses/>.
+//
+// oli.wright.github@gmail.com
+
+#pragma once
+#include "picovectorscope.h"
+#include "extras/camera.h"
+#include "shapes.h"
+#include "enemytanks.h"
+#include "projectiles.h"
+#include "debris.h"
+#include "spacetanks.h"
+
+// The most particles that get drawn in a frame.
+// This can be overridden by the build.
+#ifndef SPACETANKS_MAX_DRAWN_PARTICLES
+#    define SPACETANKS_MAX_DRAWN_PARTICLES 512
+#endif
+
+struct DrawStateShape
+{
+    FixedTransform3D modelToWorld;
+    Intensity        intensity;
+    FixedShape       shape;
+};
+
+struct DrawStatePoint
+{
+    StandardFixedTranslationVector pos;
+    Intensity                      intensity;
+};
+
+struct DrawStateScreenPoint
+{
+    DisplayListVector2 pos;
+    Intensity          intensity;
+};
+
+// Everything that drawing needs from the simulation for one frame.
+// The simulation captures into one of these after advancing, and drawing
+// only reads from it, so the two halves of the frame can run on different
+// cores with a couple of these in flight.
+// Things that never move (obstacles, grid, background) are drawn straight
+// from their constant data, so they're not in here.
+struct DrawState
+{
+    // Every shape comes from a pool, so this is enough for the worst case:
+    // a tank and its radar dish each, every projectile and every chunk of debris
+    static constexpr uint kMaxShapes = (2 * kMaxEnemyTanks) + kMaxProjectiles + kMaxDebrisChunks;
+    static constexpr uint kMaxPoints = SPACETANKS_MAX_DRAWN_PARTICLES;
+    static constexpr uint kMaxScreenPoints = kMaxEnemyTanks;
+
+    void Clear()
+    {
+        numShapes = 0;
+        numPoints = 0;
+        numScreenPoints = 0;
+    }
+
+    // These return false, and drop the thing, if there's no room.
+    // There's always room for shapes, unless kMaxShapes has fallen behind the pools.
+    bool PushShape(FixedShape shape, const FixedTransform3D& modelToWorld, Intensity intensity)
+    {
+        assert(numShapes < kMaxShapes);
+        if(numShapes == kMaxShapes) return false;
+        DrawStateShape& drawShape = shapes[numShapes++];
+        drawShape.modelToWorld = modelToWorld;
+        drawShape.intensity = intensity;
+        drawShape.shape = shape;
+        return true;
+    }
+
+    bool PushPoint(const StandardFixedTranslationVector& pos, Intensity intensity)
+    {
+        if(numPoints == kMaxPoints) return false;
+        points[numPoints].pos = pos;
+        points[numPoints++].intensity = intensity;
+        return true;
+    }
+
+    bool PushScreenPoint(const DisplayListVector2& pos, Intensity intensity)
+    {
+        if(numScreenPoints == kMaxScreenPoints) return false;
+        screenPoints[numScreenPoints].pos = pos;
+        screenPoints[numScreenPoints++].intensity = intensity;
+        return true;
+    }
+
+    Camera camera;
+    Angle  radarAngle;
+
+    DrawStateShape       shapes[kMaxShapes];
+    DrawStatePoint       points[kMaxPoints];          //< In world space
+    DrawStateScreenPoint screenPoints[kMaxScreenPoints]; //< For the HUD
+    uint numShapes = 0;
+    uint numPoints = 0;
+    uint numScreenPoints = 0;
+};
@@ -23,16 +23,23 @@
 #include "player.h"
 #include "projectiles.h"
 #include "particles.h"
+#include "debris.h"
 #include "collisions.h"
 #include "shapes.h"
+#include "simulation.h"
+#include "drawstate.h"
+#include "navigation.h"
+#include "lineofsight.h"
+#include "spawnpoints.h"
 
 static constexpr Angle kRadarDishRotationSpeed = 3.f * (float) kPerSecondMultiplier;
 static constexpr StandardFixedTranslationScalar kRadarDishOffsetZ = -0.5f;
 static constexpr Angle kRotationSpeed = 0.3f * (float) kPerSecondMultiplier;
+static constexpr Angle kSteeringSpeed = 1.f * (float) kPerSecondMultiplier; //< When moving
 static constexpr Angle kAimAngleTolerance = kPi * 0.001f;
 static constexpr StandardFixedTranslationScalar kTranslationSpeed = 2.f * (float) kPerSecondMultiplier;
-//static constexpr int kCoolDownTicks = 2 * (int_fast16_t) kFramesPerSecond;
-static constexpr int kNumDebrisChunks = 5;
+static constexpr StandardFixedTranslationScalar kCollisionRadius = 0.3f;
+//static constexpr int kCoolDownTicks = 2 * (int_fast16_t) kTicksPerSecond;
 
 enum class Behaviour
 {
@@ -45,288 +52,321 @@ enum class Behaviour
 
 static constexpr int kNumTicksInBehaviourPhase[] = 
 {
-    (int) (kFramesPerSecond * 6.f ), // TurnToPlayer
-    (int) (kFramesPerSecond * 1.5f), // Move
-    (int) (kFramesPerSecond * 4.f),  // Dead
+    (int) (kTicksPerSecond * 6.f ), // TurnToPlayer
+    (int) (kTicksPerSecond * 1.5f), // Move
+    (int) (kTicksPerSecond * 4.f),  // Dead
 };
 static_assert(count_of(kNumTicksInBehaviourPhase) == (size_t) Behaviour::Count, "");
 
-static int s_numActiveTanks = 0;
-
-class DebrisChunk : public ParticleBase
+// Tanks only think (pick a target, change behaviour, decide to fire) on
+// one tick in every kNumThinkBuckets, round-robin by index, and just steer
+// on the others.  That spreads the cost evenly across ticks.
+// By default they think about 30 times a second.
+// This can be overridden by the build.
+#ifndef SPACETANKS_AI_THINK_BUCKETS
+#    define SPACETANKS_AI_THINK_BUCKETS ((kTicksPerSecond.getIntegerPart() >= 60) ? (kTicksPerSecond.getIntegerPart() / 30) : 1)
+#endif
+static constexpr uint kNumThinkBuckets = SPACETANKS_AI_THINK_BUCKETS;
+static_assert(kNumThinkBuckets > 0, "");
+
+// The tanks are split into arrays by how the data gets used, and the
+// active ones are packed into [0, s_numActiveTanks), so that Update and
+// Capture only walk the live data.  Tanks are never removed, so a tank's
+// index stays the same and its projectile index can be derived from it.
+static uint s_numActiveTanks = 0;
+
+// Behaviour timers
+static Behaviour s_behaviour[kMaxEnemyTanks];
+static uint16_t  s_numTicksLeftInBehaviour[kMaxEnemyTanks];
+
+// Orientation
+static Angle     s_yaw[kMaxEnemyTanks];
+static Angle     s_targetYaw[kMaxEnemyTanks]; //< From the last think
+static Angle     s_radarDishYaw[kMaxEnemyTanks];
+
+// Placement
+static FixedTransform3D               s_modelToWorld[kMaxEnemyTanks];
+static StandardFixedTranslationVector s_prevPos[kMaxEnemyTanks]; //< For drawing between ticks
+
+static CollisionObject* s_collisionObject[kMaxEnemyTanks];
+
+// Which tanks think this tick
+static uint s_thinkBucket = 0;
+
+static int getProjectileIdx(uint idx)
 {
-public:
-    DebrisChunk() : ParticleBase()
-    , m_shape(FixedShape::Chunk0)
-    {}
-
-    void Activate(const StandardFixedTranslationVector& pos, const StandardFixedTranslationVector& velocity)
-    {
-        ParticleBase::Activate(pos, velocity);
-
-        StandardFixedOrientationVector rotationAngles;
-        static const float kMaxRadsPerSecond = 0.2f;
-        rotationAngles.x = StandardFixedTranslationScalar::randMinusOneToOne() * kMaxRadsPerSecond * kPerSecondMultiplier;
-        rotationAngles.y = StandardFixedTranslationScalar::randMinusOneToOne() * kMaxRadsPerSecond * kPerSecondMultiplier;
-        rotationAngles.z = StandardFixedTranslationScalar::randMinusOneToOne() * kMaxRadsPerSecond * kPerSecondMultiplier;
-        m_rotation.setRotationXYZ(rotationAngles.x, rotationAngles.y, rotationAngles.z);
-        m_rotation.setTranslation(StandardFixedTranslationVector(0, 0, 0));
-
-        m_modelToWorld.setAsIdentity();
-        m_modelToWorld.markAsManuallyManipulated();
-        m_modelToWorld.setTranslation(pos);
-    }
-
-    void Update()
-    {
-        ParticleBase::Update();
-        if(!IsActive())
-        {
-            return;
-        }
-        m_modelToWorld *= m_rotation;
-        m_modelToWorld.t = m_pos;
-    }
+    // The player has projectile 0
+    return (int) idx + 1;
+}
 
-    void Draw(DisplayList& displayList, const Camera& camera) const
+static void respawn(uint idx)
+{
+    FixedTransform3D& modelToWorld = s_modelToWorld[idx];
+    modelToWorld.t = SpawnPoints::Pick();
+    modelToWorld.t.y = 0.625f;
+    // Don't draw it sliding across from where it died
+    s_prevPos[idx] = modelToWorld.t;
+    s_yaw[idx] = StandardFixedOrientationScalar::randZeroToOne() * (kPi * 2.f);
+    modelToWorld.setRotationXYZ(0, s_yaw[idx], 0);
+    s_radarDishYaw[idx] = 0;
+
+    if(s_collisionObject[idx] == nullptr)
     {
-        GetFixedShape(m_shape).Draw(displayList, m_modelToWorld, camera, m_intrinsicBrightness * 3.f);
+        // If we've run out of collision objects, the tank can't be shot.
+        // We'll try again next time it respawns.
+        s_collisionObject[idx] = Collisions::AllocateObject();
     }
+}
 
-    void SetShape(FixedShape shape) { m_shape = shape; }
-
-private:
-    FixedTransform3D m_modelToWorld;
-    FixedTransform3D m_rotation;
-    FixedShape m_shape;
-};
-
-static DebrisChunk s_debrisChunks[kNumDebrisChunks];
+static void setBehaviour(uint idx, Behaviour behaviour)
+{
+    s_behaviour[idx] = behaviour;
+    s_numTicksLeftInBehaviour[idx] = (uint16_t) kNumTicksInBehaviourPhase[(int) behaviour];
+}
 
-// An individual enemy tank
-class EnemyTank
+static Angle calcYawDiff(uint idx)
 {
-public:
-    EnemyTank()
-    : m_active(false)
-    {}
+    Angle yawDiff = s_targetYaw[idx] - s_yaw[idx];
+    if(yawDiff > kPi) yawDiff -= k2Pi;
+    else if(yawDiff < -kPi) yawDiff += k2Pi;
+    return yawDiff;
+}
 
-    bool IsActive() const { return m_active; }
-    bool IsAlive() const { return IsActive() && (m_behaviour != Behaviour::Dead); }
+static Angle calcYawTowards(uint idx, const StandardFixedTranslationVector& pos)
+{
+    const StandardFixedTranslationVector& tankPos = s_modelToWorld[idx].t;
+    return StandardFixedTranslationScalar::ApproxATan2(tankPos.x - pos.x, tankPos.z - pos.z) + (kPi * 0.5f);
+}
 
-    void Respawn()
+// The expensive part of turning to the player, which only happens when thinking
+static void aimAtPlayer(uint idx)
+{
+    const FixedTransform3D& modelToWorld = s_modelToWorld[idx];
+    const StandardFixedTranslationVector& playerPos = Player::GetPosition();
+    s_targetYaw[idx] = calcYawTowards(idx, playerPos);
+    const int projectileIdx = getProjectileIdx(idx);
+    // Don't waste a shot on an obstacle
+    if(!Projectiles::IsActive(projectileIdx) &&
+       (Abs(calcYawDiff(idx)) < kAimAngleTolerance) &&
+       LineOfSight::IsClear(idx, modelToWorld.t, playerPos))
     {
-        // Find a good spawn location
-        while(true)
-        {
-            constexpr StandardFixedTranslationScalar kRange = 16;
-            m_modelToWorld.t.x = StandardFixedTranslationScalar::randMinusOneToOne() * kRange;
-            m_modelToWorld.t.y = 0.625f;
-            m_modelToWorld.t.z = StandardFixedTranslationScalar::randMinusOneToOne() * kRange;
-            break;
-        }
-        m_yaw = StandardFixedOrientationScalar::randZeroToOne() * (kPi * 2.f);
-        m_radarDishYaw = 0;
-
+        // The player can't be damaged yet, so the shot leaves the player's
+        // collision object out and flies on through, as it always has
+        Projectiles::Create(projectileIdx, modelToWorld, kCollisionMaskProjectileObstacle);
     }
+}
 
-    void Update()
+static void think(uint idx)
+{
+    if(s_numTicksLeftInBehaviour[idx] == 0)
     {
-        m_radarDishYaw += kRadarDishRotationSpeed;
-        if(m_radarDishYaw > (kPi * 2))
-        {
-            m_radarDishYaw -= (kPi * 2);
-        }
-        if(--m_numTicksLeftInBehaviour == 0)
-        {
-            switch(m_behaviour)
-            {
-                case Behaviour::TurnToPlayer:
-                    m_behaviour = Behaviour::Move;
-                    break;
-                case Behaviour::Move:
-                    m_behaviour = Behaviour::TurnToPlayer;
-                    break;
-                case Behaviour::Dead:
-                    Respawn();
-                    m_behaviour = Behaviour::TurnToPlayer;
-                default:
-                    break;
-            }
-            m_numTicksLeftInBehaviour = kNumTicksInBehaviourPhase[(int) m_behaviour];
-        }
-
-        switch(m_behaviour)
+        switch(s_behaviour[idx])
         {
             case Behaviour::TurnToPlayer:
-            {
-                const StandardFixedTranslationVector& playerPos = Player::GetPosition();
-                Angle targetYaw = StandardFixedTranslationScalar::ApproxATan2(m_modelToWorld.t.x - playerPos.x, m_modelToWorld.t.z - playerPos.z) + (kPi * 0.5f);
-                Angle yawDiff = targetYaw - m_yaw;
-                if(yawDiff > kPi) yawDiff -= k2Pi;
-                else if(yawDiff < -kPi) yawDiff += k2Pi;
-                if(yawDiff > kAimAngleTolerance)
-                {
-                    m_yaw += kRotationSpeed;
-                    if(m_yaw > k2Pi) m_yaw -= k2Pi;
-                }
-                else if(yawDiff < -kAimAngleTolerance)
-                {
-                    m_yaw -= kRotationSpeed;
-                    if(m_yaw < 0) m_yaw += k2Pi;
-                }
-                m_modelToWorld.setRotationXYZ(0, m_yaw, 0);
-                if(!Projectiles::IsActive(m_projectileIdx) && (Abs(yawDiff) < kAimAngleTolerance))
-                {
-                    Projectiles::Create(m_projectileIdx, m_modelToWorld, kCollisionMaskProjectileObstacle | kCollisionMaskPlayer);
-                }
+                setBehaviour(idx, Behaviour::Move);
                 break;
-            }
             case Behaviour::Move:
-            {
-                StandardFixedTranslationVector stepWorldSpace;
-                m_modelToWorld.rotateVector(stepWorldSpace, StandardFixedTranslationVector(kTranslationSpeed, 0, 0));
-                m_modelToWorld.translate(stepWorldSpace);
-                break;
-            }
-            case Behaviour::Dead:
-            {
-                break;
-            }
-            default:
+                setBehaviour(idx, Behaviour::TurnToPlayer);
                 break;
-        }
-        m_collisionObject->Configure(m_modelToWorld, 0.3f, kCollisionMaskEnemy, 0.3f);
-    }
-
-    void Draw(DisplayList& displayList, const Camera& camera) const
-    {
-        switch(m_behaviour)
-        {
             case Behaviour::Dead:
+                respawn(idx);
+                setBehaviour(idx, Behaviour::TurnToPlayer);
                 break;
-
             default:
-            {
-                // Tank
-                GetFixedShape(FixedShape::Tank1).Draw(displayList, m_modelToWorld, camera, kIntensityAdjustment);
-                // Radar dish
-                FixedTransform3D modelToWorld;
-                modelToWorld.setTranslation(m_modelToWorld * StandardFixedTranslationVector(kRadarDishOffsetZ, 0, 0));
-                modelToWorld.setRotationXYZ(0, m_radarDishYaw, 0);
-                GetFixedShape(FixedShape::Radar).Draw(displayList, modelToWorld, camera, kIntensityAdjustment);
                 break;
-            }
         }
     }
-
-    void Destroy()
+    switch(s_behaviour[idx])
     {
-        m_behaviour = Behaviour::Dead;
-        m_numTicksLeftInBehaviour = kNumTicksInBehaviourPhase[(int) m_behaviour];
-        for(DebrisChunk& debrisChunk : s_debrisChunks)
+        case Behaviour::TurnToPlayer:
+            aimAtPlayer(idx);
+            break;
+        case Behaviour::Move:
         {
-            StandardFixedTranslationVector velocity;
-            velocity.x = StandardFixedTranslationScalar::randMinusOneToOne();
-            velocity.y = StandardFixedTranslationScalar::randZeroToOne();
-            velocity.z = StandardFixedTranslationScalar::randMinusOneToOne();
-            velocity *= kPerSecondMultiplier * 5.f;
-            debrisChunk.Activate(m_modelToWorld.t, velocity);
+            // Follow the flow field round any obstacles, or just carry on
+            // the way we're facing if it has nothing to say
+            StandardFixedTranslationVector waypoint;
+            s_targetYaw[idx] = Navigation::GetNextWaypoint(s_modelToWorld[idx].t, waypoint) ? calcYawTowards(idx, waypoint) : s_yaw[idx];
+            break;
         }
+        default:
+            break;
     }
+}
 
-    void Activate()
+// The cheap part, every tick
+static void turnToTarget(uint idx, Angle rotationSpeed)
+{
+    Angle& yaw = s_yaw[idx];
+    const Angle yawDiff = calcYawDiff(idx);
+    // Don't overshoot, or steering at lower tick rates would wobble either
+    // side of the target
+    if(yawDiff > kAimAngleTolerance)
     {
-        m_active = true;
-        ++s_numActiveTanks;
-
-        Respawn();
-        m_behaviour = Behaviour::TurnToPlayer;
-        m_numTicksLeftInBehaviour = kNumTicksInBehaviourPhase[(int) m_behaviour];
-
-        m_collisionObject = &Collisions::AllocateObject();
+        yaw += (yawDiff < rotationSpeed) ? yawDiff : rotationSpeed;
+        if(yaw > k2Pi) yaw -= k2Pi;
     }
-
-    void DeActivate()
+    else if(yawDiff < -kAimAngleTolerance)
     {
-        m_active = false;
-        --s_numActiveTanks;
-        Collisions::FreeObject(*m_collisionObject);
-        m_collisionObject = nullptr;
+        yaw -= (-yawDiff < rotationSpeed) ? -yawDiff : rotationSpeed;
+        if(yaw < 0) yaw += k2Pi;
     }
-
-    void SetProjectileIdx(int idx) { m_projectileIdx = idx; }
-
-    bool OwnsCollisionObject(const CollisionObject& collisionObject) const
+    else
     {
-        return (m_collisionObject == &collisionObject);
+        // Already facing the target, so the rotation hasn't changed
+        return;
     }
+    s_modelToWorld[idx].setRotationXYZ(0, yaw, 0);
+}
 
-    const FixedTransform3D& GetModelToWorld() const { return m_modelToWorld; }
-
-private:
-    bool      m_active;
-    Angle     m_yaw;
-    Angle     m_radarDishYaw;
-    Behaviour m_behaviour;
-    int       m_numTicksLeftInBehaviour;
-    int       m_projectileIdx;
-    FixedTransform3D m_modelToWorld;
-    CollisionObject* m_collisionObject;
-};
+static void move(uint idx)
+{
+    FixedTransform3D& modelToWorld = s_modelToWorld[idx];
+    StandardFixedTranslationVector stepWorldSpace;
+    modelToWorld.rotateVector(stepWorldSpace, StandardFixedTranslationVector(kTranslationSpeed, 0, 0));
+    modelToWorld.t = Collisions::Slide(modelToWorld.t,
+                                       stepWorldSpace,
+                                       kCollisionRadius,
+                                       kCollisionMaskTankObstacle | kCollisionMaskEnemy | kCollisionMaskPlayer,
+                                       s_collisionObject[idx]);
+}
 
-static EnemyTank s_enemyTanks[kMaxEnemyTanks];
+static void destroy(uint idx)
+{
+    setBehaviour(idx, Behaviour::Dead);
+    const StandardFixedTranslationVector& pos = s_modelToWorld[idx].t;
+    Debris::Explode(pos);
+    const StandardFixedOrientationVector up(0, 1, 0);
+    Particles::Spawn(ParticleEmitter::TankExplosion, pos, up);
+    StandardFixedTranslationVector groundPos = pos;
+    groundPos.y = 0;
+    Particles::Spawn(ParticleEmitter::GroundDust, groundPos, up);
+}
 
 void EnemyTanks::Reset()
 {
-    for(int i = 0; i < kMaxEnemyTanks; ++i)
+    // Forget the collision objects without freeing them, because
+    // Collisions::Reset has already taken them all back
+    s_numActiveTanks = 0;
+    s_thinkBucket = 0;
+    for(uint i = 0; i < SPACETANKS_NUM_ENEMY_TANKS; ++i)
     {
-        EnemyTank& tank = s_enemyTanks[i];
-        tank.SetProjectileIdx(i + 1);
-        if(tank.IsActive()) tank.DeActivate();
+        Spawn();
     }
-    s_enemyTanks[0].Activate();
-    for(int i = 0; i < kNumDebrisChunks; ++i)
+}
+
+bool EnemyTanks::Spawn()
+{
+    if(s_numActiveTanks == (uint) kMaxEnemyTanks)
     {
-        s_debrisChunks[i].SetShape((FixedShape)((int) FixedShape::Chunk0 + i));
+        return false;
     }
+    const uint idx = s_numActiveTanks++;
+    s_collisionObject[idx] = nullptr;
+    respawn(idx);
+    setBehaviour(idx, Behaviour::TurnToPlayer);
+    aimAtPlayer(idx);
+    return true;
 }
 
 void EnemyTanks::Update()
 {
-    for(EnemyTank& tank : s_enemyTanks)
+    const uint numTanks = s_numActiveTanks;
+
+    // Timers first, which only touch the small arrays.
+    // A finished behaviour waits at zero for the tank's next think.
+    for(uint idx = 0; idx < numTanks; ++idx)
     {
-        if(tank.IsActive()) tank.Update();
+        s_radarDishYaw[idx] += kRadarDishRotationSpeed;
+        if(s_radarDishYaw[idx] > (kPi * 2))
+        {
+            s_radarDishYaw[idx] -= (kPi * 2);
+        }
+        if(s_numTicksLeftInBehaviour[idx] != 0)
+        {
+            --s_numTicksLeftInBehaviour[idx];
+        }
     }
-    for(DebrisChunk& debrisChunk : s_debrisChunks)
+
+    // Then this tick's share of the thinking
+    for(uint idx = s_thinkBucket; idx < numTanks; idx += kNumThinkBuckets)
     {
-        if(debrisChunk.IsActive()) debrisChunk.Update();
+        think(idx);
     }
-}
-
-void EnemyTanks::Draw(DisplayList& displayList, const Camera& camera)
-{
-    for(const EnemyTank& tank : s_enemyTanks)
+    if(++s_thinkBucket == kNumThinkBuckets)
     {
-        if(tank.IsActive()) tank.Draw(displayList, camera);
+        s_thinkBucket = 0;
     }
-    for(const DebrisChunk& debrisChunk : s_debrisChunks)
+
+    // Then the behaviours themselves
+    for(uint idx = 0; idx < numTanks; ++idx)
     {
-        if(debrisChunk.IsActive()) debrisChunk.Draw(displayList, camera);
+        s_prevPos[idx] = s_modelToWorld[idx].t;
+        switch(s_behaviour[idx])
+        {
+            case Behaviour::TurnToPlayer:
+                turnToTarget(idx, kRotationSpeed);
+                break;
+            case Behaviour::Move:
+                turnToTarget(idx, kSteeringSpeed);
+                move(idx);
+                break;
+            case Behaviour::Dead:
+            default:
+                break;
+        }
+        if(s_collisionObject[idx] != nullptr)
+        {
+            // Dead tanks keep their object for when they respawn, but mustn't block or be shot
+            const uint mask = (s_behaviour[idx] == Behaviour::Dead) ? kCollisionMaskInert : kCollisionMaskEnemy;
+            s_collisionObject[idx]->Configure(s_modelToWorld[idx], kCollisionRadius, mask, 0.3f);
+        }
     }
+}
 
+void EnemyTanks::Capture(DrawState& drawState)
+{
+    const StandardFixedTranslationScalar tickFraction = Simulation::GetTickFraction();
+    for(uint idx = 0; idx < s_numActiveTanks; ++idx)
+    {
+        if(s_behaviour[idx] == Behaviour::Dead)
+        {
+            continue;
+        }
+        // Tank, placed between the last two ticks.  It doesn't turn
+        // quickly enough to be worth interpolating the rotation too.
+        const FixedTransform3D& modelToWorld = s_modelToWorld[idx];
+        const StandardFixedTranslationVector& prevPos = s_prevPos[idx];
+        FixedTransform3D tankToWorld = modelToWorld;
+        tankToWorld.t = prevPos + ((modelToWorld.t - prevPos) * tickFraction);
+        drawState.PushShape(FixedShape::Tank1, tankToWorld, kIntensityAdjustment);
+        // Radar dish
+        FixedTransform3D dishToWorld;
+        dishToWorld.setTranslation(tankToWorld * StandardFixedTranslationVector(kRadarDishOffsetZ, 0, 0));
+        dishToWorld.setRotationXYZ(0, s_radarDishYaw[idx], 0);
+        drawState.PushShape(FixedShape::Radar, dishToWorld, kIntensityAdjustment);
+    }
 }
 
 void EnemyTanks::Destroy(const class CollisionObject& collisionObject)
 {
-    for(EnemyTank& tank : s_enemyTanks)
+    for(uint idx = 0; idx < s_numActiveTanks; ++idx)
     {
-        if(tank.IsActive() && tank.OwnsCollisionObject(collisionObject)) tank.Destroy();
+        if(s_collisionObject[idx] == &collisionObject)
+        {
+            if(s_behaviour[idx] != Behaviour::Dead) destroy(idx);
+            return;
+        }
     }
 }
 
-const FixedTransform3D* EnemyTanks::GetTransformIfAlive(int idx)
+uint EnemyTanks::GetNumActive()
+{
+    return s_numActiveTanks;
+}
+
+const FixedTransform3D* EnemyTanks::GetTransformIfAlive(uint idx)
 {
-    const EnemyTank& tank = s_enemyTanks[idx];
-    return tank.IsAlive() ? &tank.GetModelToWorld() : nullptr;
+    assert(idx < s_numActiveTanks);
+    return (s_behaviour[idx] != Behaviour::Dead) ? &s_modelToWorld[idx] : nullptr;
 }
@@ -22,7 +22,22 @@
 #include "picovectorscope.h"
 #include "extras/camera.h"
 
-static constexpr int kMaxEnemyTanks = 4;
+struct DrawState;
+
+// The size of the enemy tank pool.
+// This can be overridden by the build, for horde mode.  Each tank needs a
+// dynamic collision object to be shot, so raise
+// SPACETANKS_MAX_DYNAMIC_COLLISION_OBJECTS to match.
+#ifndef SPACETANKS_MAX_ENEMY_TANKS
+#    define SPACETANKS_MAX_ENEMY_TANKS 4
+#endif
+static constexpr int kMaxEnemyTanks = SPACETANKS_MAX_ENEMY_TANKS;
+
+// How many tanks there are after a Reset
+#ifndef SPACETANKS_NUM_ENEMY_TANKS
+#    define SPACETANKS_NUM_ENEMY_TANKS 1
+#endif
+static_assert(SPACETANKS_NUM_ENEMY_TANKS <= SPACETANKS_MAX_ENEMY_TANKS, "");
 
 // Static class to manage _all_ the enemy tanks
 class EnemyTanks
@@ -30,8 +45,13 @@ class EnemyTanks
 public:
     static void Reset();
     static void Update();
-    static void Draw(DisplayList& displayList, const Camera& camera);
+    static void Capture(DrawState& drawState);
     static void Destroy(const class CollisionObject& collisionObject);
-    // Returns nullptr if the specified tank is not alive
-    static const FixedTransform3D* GetTransformIfAlive(int idx);
+
+    // Add another tank.  Returns false if the pool is full.
+    static bool Spawn();
+
+    static uint GetNumActive();
+    // idx is between 0 and GetNumActive().  Returns nullptr if the tank is not alive.
+    static const FixedTransform3D* GetTransformIfAlive(uint idx);
 };
\ No newline at end of file
@@ -0,0 +1,103 @@
+// Space Tanks line of sight
+//
+//
+// Copyright (C) 2023 Oli Wright
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// A copy of the GNU General Public License can be found in the file
+// LICENSE.txt in the root of this project.
+// If not, see <https://www.gnu.org/licenses/>.
+//
+// oli.wright.github@gmail.com
+
+#include "lineofsight.h"
+#include "collisions.h"
+#include "navigation.h"
+
+// What a slot's answer was worked out for.  Positions are quantised to
+// navigation cells, which is as much movement as we care about.
+struct LineOfSightKey
+{
+    int16_t fromX, fromZ;
+    int16_t toX, toZ;
+
+    bool operator==(const LineOfSightKey& other) const
+    {
+        return (fromX == other.fromX) && (fromZ == other.fromZ) && (toX == other.toX) && (toZ == other.toZ);
+    }
+};
+
+static LineOfSightKey   s_keys[LineOfSight::kNumSlots];
+static bool             s_isClear[LineOfSight::kNumSlots];
+static bool             s_isValid[LineOfSight::kNumSlots];
+static LineOfSightStats s_stats;
+
+// Long lines are tested as a batch of shorter steps, because the swept test
+// is sized for steps about as long as a projectile's.  The world is 64 units
+// across, so 32 steps of 4 (Manhatten) covers any line inside it.
+static constexpr uint kMaxLineOfSightSteps = 32;
+static constexpr StandardFixedTranslationScalar kMaxLineOfSightStep = kCollisionCellSize;
+static CollisionTester s_stepTests[kMaxLineOfSightSteps];
+static CollisionInfo   s_stepInfos[kMaxLineOfSightSteps];
+
+void LineOfSight::Reset()
+{
+    for(bool& isValid : s_isValid)
+    {
+        isValid = false;
+    }
+    s_stats = LineOfSightStats();
+}
+
+bool LineOfSight::IsClear(uint slot, const StandardFixedTranslationVector& from, const StandardFixedTranslationVector& to)
+{
+    assert(slot < kNumSlots);
+    ++s_stats.numQueries;
+    const LineOfSightKey key = {
+        (int16_t) NavGridCellCoord(from.x), (int16_t) NavGridCellCoord(from.z),
+        (int16_t) NavGridCellCoord(to.x),   (int16_t) NavGridCellCoord(to.z) };
+    if(s_isValid[slot] && (s_keys[slot] == key))
+    {
+        ++s_stats.numCacheHits;
+        return s_isClear[slot];
+    }
+
+    // Only the static obstacles matter, so this is the same test a projectile
+    // would do, but all in one go.
+    // Halve the step until it's short enough.  Anything longer than the world
+    // is wide just gets longer steps.
+    StandardFixedTranslationVector step = to - from;
+    uint numSteps = 1;
+    while(((Abs(step.x) + Abs(step.z)) > kMaxLineOfSightStep) && (numSteps < kMaxLineOfSightSteps))
+    {
+        step.x = step.x * 0.5f;
+        step.z = step.z * 0.5f;
+        numSteps <<= 1;
+    }
+    // Testers are given the end of their step
+    StandardFixedTranslationVector stepEnd = from;
+    for(uint i = 0; i < numSteps; ++i)
+    {
+        stepEnd += step;
+        s_stepTests[i] = CollisionTester(stepEnd, step, 0.01f, kCollisionMaskProjectileObstacle);
+    }
+    const bool isClear = (Collisions::TestBatch(s_stepTests, numSteps, false/*justDoCircles*/, s_stepInfos) == 0);
+    s_keys[slot] = key;
+    s_isClear[slot] = isClear;
+    s_isValid[slot] = true;
+    return isClear;
+}
+
+const LineOfSightStats& LineOfSight::GetStats()
+{
+    return s_stats;
+}
@@ -0,0 +1,48 @@
+// Space Tanks line of sight
+//
+//
+// Copyright (C) 2023 Oli Wright
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// A copy of the GNU General Public License can be found in the file
+// LICENSE.txt in the root of this project.
+// If not, see <https://www.gnu.org/licenses/>.
+//
+// oli.wright.github@gmail.com
+
+#pragma once
+#include "picovectorscope.h"
+#include "enemytanks.h"
+
+struct LineOfSightStats
+{
+    uint numQueries   = 0;
+    uint numCacheHits = 0;
+};
+
+// Static class for asking whether a shot would get through the obstacles.
+// Each caller has its own slot, which remembers the last answer until
+// either end moves into a different navigation cell, so asking every time
+// a tank thinks rarely costs a collision test.
+class LineOfSight
+{
+public:
+    // One slot for each enemy tank
+    static constexpr uint kNumSlots = kMaxEnemyTanks;
+
+    static void Reset();
+
+    // Returns true if a projectile could get from 'from' to 'to' without hitting an obstacle
+    static bool IsClear(uint slot, const StandardFixedTranslationVector& from, const StandardFixedTranslationVector& to);
+
+    static const LineOfSightStats& GetStats();
+};
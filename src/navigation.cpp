@@ -0,0 +1,235 @@
+// Space Tanks navigation
+//
+//
+// Copyright (C) 2023 Oli Wright
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// A copy of the GNU General Public License can be found in the file
+// LICENSE.txt in the root of this project.
+// If not, see <https://www.gnu.org/licenses/>.
+//
+// oli.wright.github@gmail.com
+
+#include "navigation.h"
+#include "player.h"
+#include <cstring>
+
+// How many cells the flow field search gets through each tick
+static constexpr uint kNumCellsPerUpdate = 512;
+
+// Closer than this, and a tank can see the player anyway
+static constexpr uint8_t kArrivedDistance = 3;
+
+// The search frontier is never more than a couple of rings around the
+// start cell, so this can be a lot smaller than the grid
+static constexpr uint kSearchQueueSize = 1024; // Must be a power of 2
+static_assert((kSearchQueueSize & (kSearchQueueSize - 1)) == 0, "");
+
+// A cell's distance from the player, in steps
+static constexpr uint8_t kUnreached = 0xff;
+
+static const NavGridBlockedCells* s_blockedCells = nullptr;
+
+// The flow field is stored as distances.  Tanks head for whichever
+// neighbouring cell is closest.
+// s_distances[s_readBuffer] is the finished one, and the other is being built.
+static uint8_t  s_distances[2][kNumNavGridCells];
+static uint     s_readBuffer = 0;
+static bool     s_haveFlowField = false;
+
+// The search in progress
+static uint16_t s_searchQueue[kSearchQueueSize];
+static uint     s_searchHead = 0;
+static uint     s_searchTail = 0;
+static bool     s_searching = false;
+static int      s_targetCellX = -1;
+static int      s_targetCellZ = -1;
+
+// The 8 neighbours, with the diagonals last
+static constexpr int kNeighbourX[] = { 1, -1, 0,  0, 1, -1,  1, -1 };
+static constexpr int kNeighbourZ[] = { 0,  0, 1, -1, 1,  1, -1, -1 };
+static constexpr uint kNumNeighbours = 8;
+
+// The middle of each row or column of cells
+struct NavGridCellCentres
+{
+    StandardFixedTranslationScalar centres[kNavGridCellsPerAxis];
+};
+
+static constexpr NavGridCellCentres makeNavGridCellCentres()
+{
+    NavGridCellCentres cellCentres = {};
+    for(uint i = 0; i < kNavGridCellsPerAxis; ++i)
+    {
+        cellCentres.centres[i] = (float) kNavGridMin + (((float) i + 0.5f) * (float) kNavGridCellSize);
+    }
+    return cellCentres;
+}
+static constexpr NavGridCellCentres kNavGridCellCentres = makeNavGridCellCentres();
+
+static bool isBlocked(int cellX, int cellZ)
+{
+    return (s_blockedCells != nullptr) && s_blockedCells->IsBlocked(NavGridCellIndex(cellX, cellZ));
+}
+
+// Diagonal steps mustn't cut the corner of a blocked cell
+static bool canStep(int cellX, int cellZ, uint neighbour)
+{
+    const int x = cellX + kNeighbourX[neighbour];
+    const int z = cellZ + kNeighbourZ[neighbour];
+    if(!IsOnNavGrid(x, z) || isBlocked(x, z))
+    {
+        return false;
+    }
+    if((kNeighbourX[neighbour] != 0) && (kNeighbourZ[neighbour] != 0))
+    {
+        return !isBlocked(x, cellZ) && !isBlocked(cellX, z);
+    }
+    return true;
+}
+
+static void startSearch(int cellX, int cellZ)
+{
+    s_targetCellX = cellX;
+    s_targetCellZ = cellZ;
+    uint8_t* distances = s_distances[s_readBuffer ^ 1];
+    memset(distances, kUnreached, kNumNavGridCells);
+    const uint cellIdx = NavGridCellIndex(cellX, cellZ);
+    distances[cellIdx] = 0;
+    s_searchQueue[0] = (uint16_t) cellIdx;
+    s_searchHead = 0;
+    s_searchTail = 1;
+    s_searching = true;
+}
+
+static void continueSearch()
+{
+    uint8_t* distances = s_distances[s_readBuffer ^ 1];
+    for(uint i = 0; (i < kNumCellsPerUpdate) && (s_searchHead != s_searchTail); ++i)
+    {
+        const uint cellIdx = s_searchQueue[s_searchHead++ & (kSearchQueueSize - 1)];
+        const int cellX = (int) (cellIdx % kNavGridCellsPerAxis);
+        const int cellZ = (int) (cellIdx / kNavGridCellsPerAxis);
+        const uint8_t distance = distances[cellIdx];
+        if(distance == kUnreached - 1)
+        {
+            // Anything further away is too far to care about
+            continue;
+        }
+        for(uint neighbour = 0; neighbour < kNumNeighbours; ++neighbour)
+        {
+            if(!canStep(cellX, cellZ, neighbour))
+            {
+                continue;
+            }
+            const uint neighbourIdx = NavGridCellIndex(cellX + kNeighbourX[neighbour], cellZ + kNeighbourZ[neighbour]);
+            if(distances[neighbourIdx] != kUnreached)
+            {
+                continue;
+            }
+            distances[neighbourIdx] = distance + 1;
+            assert((s_searchTail - s_searchHead) < kSearchQueueSize);
+            s_searchQueue[s_searchTail++ & (kSearchQueueSize - 1)] = (uint16_t) neighbourIdx;
+        }
+    }
+    if(s_searchHead == s_searchTail)
+    {
+        // Done, so the tanks can start using it
+        s_readBuffer ^= 1;
+        s_haveFlowField = true;
+        s_searching = false;
+    }
+}
+
+void Navigation::Reset()
+{
+    s_readBuffer = 0;
+    s_haveFlowField = false;
+    s_searching = false;
+    s_targetCellX = -1;
+    s_targetCellZ = -1;
+}
+
+void Navigation::SetBlockedCells(const NavGridBlockedCells& blockedCells)
+{
+    s_blockedCells = &blockedCells;
+}
+
+void Navigation::Update()
+{
+    // Start again if the player has moved to another cell, even if we're
+    // part way through
+    const StandardFixedTranslationVector& playerPos = Player::GetPosition();
+    const int cellX = NavGridCellCoord(playerPos.x);
+    const int cellZ = NavGridCellCoord(playerPos.z);
+    if(((cellX != s_targetCellX) || (cellZ != s_targetCellZ)) && IsOnNavGrid(cellX, cellZ))
+    {
+        startSearch(cellX, cellZ);
+    }
+    if(s_searching)
+    {
+        continueSearch();
+    }
+}
+
+bool Navigation::IsBlocked(const StandardFixedTranslationVector& pos)
+{
+    const int cellX = NavGridCellCoord(pos.x);
+    const int cellZ = NavGridCellCoord(pos.z);
+    return IsOnNavGrid(cellX, cellZ) && isBlocked(cellX, cellZ);
+}
+
+bool Navigation::GetNextWaypoint(const StandardFixedTranslationVector& pos, StandardFixedTranslationVector& waypoint)
+{
+    if(!s_haveFlowField)
+    {
+        return false;
+    }
+    const int cellX = NavGridCellCoord(pos.x);
+    const int cellZ = NavGridCellCoord(pos.z);
+    if(!IsOnNavGrid(cellX, cellZ))
+    {
+        return false;
+    }
+    const uint8_t* distances = s_distances[s_readBuffer];
+    const uint8_t distance = distances[NavGridCellIndex(cellX, cellZ)];
+    if(distance <= kArrivedDistance)
+    {
+        return false;
+    }
+    // A tank squeezed up against an obstacle can be in a blocked cell, which
+    // was never reached.  It can still step out to any open neighbour.
+    uint8_t bestDistance = distance;
+    uint bestNeighbour = kNumNeighbours;
+    for(uint neighbour = 0; neighbour < kNumNeighbours; ++neighbour)
+    {
+        if(!canStep(cellX, cellZ, neighbour))
+        {
+            continue;
+        }
+        const uint8_t neighbourDistance = distances[NavGridCellIndex(cellX + kNeighbourX[neighbour], cellZ + kNeighbourZ[neighbour])];
+        if(neighbourDistance < bestDistance)
+        {
+            bestDistance = neighbourDistance;
+            bestNeighbour = neighbour;
+        }
+    }
+    if(bestNeighbour == kNumNeighbours)
+    {
+        return false;
+    }
+    // Head for the middle of the cell
+    waypoint.x = kNavGridCellCentres.centres[cellX + kNeighbourX[bestNeighbour]];
+    waypoint.y = pos.y;
+    waypoint.z = kNavGridCellCentres.centres[cellZ + kNeighbourZ[bestNeighbour]];
+    return true;
+}
@@ -0,0 +1,82 @@
+// Space Tanks navigation
+//
+//
+// Copyright (C) 2023 Oli Wright
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// A copy of the GNU General Public License can be found in the file
+// LICENSE.txt in the root of this project.
+// If not, see <https://www.gnu.org/licenses/>.
+//
+// oli.wright.github@gmail.com
+
+#pragma once
+#include "picovectorscope.h"
+
+// The navigation grid covers the arena with square cells, which are either
+// blocked by an obstacle or not.  Anything outside it is left to fend for itself.
+static constexpr uint kNavGridCellsPerAxis = 64;
+static constexpr uint kNumNavGridCells = kNavGridCellsPerAxis * kNavGridCellsPerAxis;
+static constexpr StandardFixedTranslationScalar kNavGridCellSize = 1.f;
+static constexpr StandardFixedTranslationScalar kRecipNavGridCellSize = 1.f / (float) kNavGridCellSize;
+static constexpr StandardFixedTranslationScalar kNavGridMin = -32.f; //< In x and z
+static_assert(kNumNavGridCells <= 0x10000, "Cell indices need to fit in 16 bits");
+
+// Returns a cell coordinate, which may be off the grid
+constexpr int NavGridCellCoord(StandardFixedTranslationScalar v)
+{
+    return ((v - kNavGridMin) * kRecipNavGridCellSize).getIntegerPart();
+}
+
+constexpr bool IsOnNavGrid(int cellX, int cellZ)
+{
+    return ((uint) cellX < kNavGridCellsPerAxis) && ((uint) cellZ < kNavGridCellsPerAxis);
+}
+
+constexpr uint NavGridCellIndex(int cellX, int cellZ)
+{
+    return (uint) cellX + ((uint) cellZ * kNavGridCellsPerAxis);
+}
+
+// One bit per cell, built at compile-time from the obstacles
+struct NavGridBlockedCells
+{
+    uint32_t bits[kNumNavGridCells / 32] = {};
+
+    constexpr void SetBlocked(uint cellIdx) { bits[cellIdx >> 5] |= 1u << (cellIdx & 31); }
+    constexpr bool IsBlocked(uint cellIdx) const { return (bits[cellIdx >> 5] & (1u << (cellIdx & 31))) != 0; }
+};
+
+// Static class for finding the way to the player.
+// There's a single flow field towards the player that all the tanks share.
+// It's rebuilt when the player moves into a different cell, a slice per
+// tick, while the tanks carry on using the previous one.
+class Navigation
+{
+public:
+    static void Reset();
+
+    // Set the blocked cells.  They must outlive the navigation grid.
+    static void SetBlockedCells(const NavGridBlockedCells& blockedCells);
+
+    // Carry on building the flow field
+    static void Update();
+
+    // Whether pos is in a cell that a tank can't get into.
+    // Anywhere off the grid isn't blocked.
+    static bool IsBlocked(const StandardFixedTranslationVector& pos);
+
+    // Find where to head for next from pos, to get to the player.
+    // Returns false if pos is off the grid, can't reach the player, or is
+    // already close.
+    static bool GetNextWaypoint(const StandardFixedTranslationVector& pos, StandardFixedTranslationVector& waypoint);
+};
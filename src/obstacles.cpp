@@ -22,6 +22,7 @@
 #include "shapes.h"
 #include "collisions.h"
 #include "spacetanks.h"
+#include "navigation.h"
 
 struct ObstacleTypeDef
 {
@@ -30,6 +31,7 @@ struct ObstacleTypeDef
     StandardFixedTranslationScalar m_tankCollisionRadius;
     StandardFixedTranslationScalar m_projectileCollisionRadius;
     SinTable::Index  m_surfaceAngle;
+    StandardFixedTranslationScalar m_height;
 
     // constexpr constructor, so the array is built at compile-time
     constexpr ObstacleTypeDef(  FixedShape shape,
@@ -43,6 +45,7 @@ struct ObstacleTypeDef
     , m_tankCollisionRadius(tankCollisionRadius)
     , m_projectileCollisionRadius(projectileCollisionRadius)
     , m_surfaceAngle(surfaceAngle)
+    , m_height(yScale * 1.25f) //< The shapes are 1.25 tall before scaling
     {}
 };
 enum class ObstacleType
@@ -106,6 +109,113 @@ constexpr ObstacleInstance kObstacles[] =
 };
 static constexpr uint kNumObstacles = (uint) count_of(kObstacles);
 
+// Build the collision objects for the obstacles at compile-time.
+// Each obstacle gets a collision object for tanks, and pyramids get a smaller
+// one for projectiles, so they hit the sloped surface.
+// The tank objects cover the whole footprint and know how tall the obstacle
+// is, so particles use them too.  Tanks slide along the XZ part of the
+// surface normal, so giving pyramids' tank objects the slope doesn't change
+// how tanks move, but it does bounce particles up the side.
+static constexpr bool needsProjectileCollisionObject(const ObstacleTypeDef& obstacleType)
+{
+    return (obstacleType.m_tankCollisionRadius != obstacleType.m_projectileCollisionRadius) &&
+           (obstacleType.m_projectileCollisionRadius > 0);
+}
+
+static constexpr uint countCollisionObjects()
+{
+    uint count = 0;
+    for(const ObstacleInstance& obstacle : kObstacles)
+    {
+        count += needsProjectileCollisionObject(kObstacleTypeDefs[(uint)obstacle.m_type]) ? 2 : 1;
+    }
+    return count;
+}
+static constexpr uint kNumObstacleCollisionObjects = countCollisionObjects();
+
+static constexpr CollisionObjectDef makeCollisionObjectDef(uint collisionObjectIdx)
+{
+    // Find the obstacle that this collision object belongs to
+    uint obstacleIdx = 0;
+    bool isProjectileObject = false;
+    for(uint idx = 0; ; ++obstacleIdx)
+    {
+        const bool needsTwo = needsProjectileCollisionObject(kObstacleTypeDefs[(uint)kObstacles[obstacleIdx].m_type]);
+        if(collisionObjectIdx == idx)
+        {
+            break;
+        }
+        if(needsTwo && (collisionObjectIdx == idx + 1))
+        {
+            isProjectileObject = true;
+            break;
+        }
+        idx += needsTwo ? 2 : 1;
+    }
+
+    const ObstacleInstance& obstacle = kObstacles[obstacleIdx];
+    const ObstacleTypeDef& obstacleType = kObstacleTypeDefs[(uint)obstacle.m_type];
+    const CollisionTransform2D::TranslationVectorType pos(obstacle.m_position.x, obstacle.m_position.z);
+    const CollisionTransform2D::OrientationVectorType axisX(1.f, 0.f);
+    const CollisionTransform2D::OrientationVectorType axisZ(0.f, 1.f);
+    if(isProjectileObject)
+    {
+        return CollisionObjectDef {
+            CollisionShape(pos, axisX, axisZ, obstacleType.m_projectileCollisionRadius, obstacleType.m_surfaceAngle, obstacleType.m_height),
+            obstacleType.m_projectileCollisionRadius,
+            kCollisionMaskProjectileObstacle };
+    }
+    const uint mask = (obstacleType.m_tankCollisionRadius == obstacleType.m_projectileCollisionRadius) ?
+                      kCollisionMaskTankObstacle | kCollisionMaskProjectileObstacle :
+                      kCollisionMaskTankObstacle;
+    return CollisionObjectDef {
+        CollisionShape(pos, axisX, axisZ, obstacleType.m_tankCollisionRadius, obstacleType.m_surfaceAngle, obstacleType.m_height),
+        obstacleType.m_tankCollisionRadius,
+        mask };
+}
+
+struct ObstacleCollisionObjectDefs
+{
+    CollisionObjectDef defs[kNumObstacleCollisionObjects];
+};
+
+template<size_t... Is>
+static constexpr ObstacleCollisionObjectDefs makeCollisionObjectDefs(std::index_sequence<Is...>)
+{
+    return ObstacleCollisionObjectDefs { { makeCollisionObjectDef((uint) Is)... } };
+}
+
+static constexpr ObstacleCollisionObjectDefs kObstacleCollisionObjectDefs = makeCollisionObjectDefs(std::make_index_sequence<kNumObstacleCollisionObjects>());
+// This is const, so it lives in flash rather than RAM
+static constexpr StaticCollisionTable<kNumObstacleCollisionObjects> kObstacleCollisionTable = MakeStaticCollisionTable(kObstacleCollisionObjectDefs.defs);
+
+// Block every navigation cell that a tank's centre can't get into, so
+// pathing goes around the obstacles with room to spare
+static constexpr StandardFixedTranslationScalar kNavClearance = 0.3f;
+
+static constexpr NavGridBlockedCells makeNavGridBlockedCells()
+{
+    NavGridBlockedCells blockedCells;
+    for(const ObstacleInstance& obstacle : kObstacles)
+    {
+        const StandardFixedTranslationScalar extent = kObstacleTypeDefs[(uint)obstacle.m_type].m_tankCollisionRadius + kNavClearance;
+        const int minX = NavGridCellCoord(obstacle.m_position.x - extent);
+        const int maxX = NavGridCellCoord(obstacle.m_position.x + extent);
+        const int minZ = NavGridCellCoord(obstacle.m_position.z - extent);
+        const int maxZ = NavGridCellCoord(obstacle.m_position.z + extent);
+        for(int cellZ = minZ; cellZ <= maxZ; ++cellZ)
+        {
+            for(int cellX = minX; cellX <= maxX; ++cellX)
+            {
+                if(IsOnNavGrid(cellX, cellZ)) blockedCells.SetBlocked(NavGridCellIndex(cellX, cellZ));
+            }
+        }
+    }
+    return blockedCells;
+}
+// This is const, so it lives in flash rather than RAM
+static constexpr NavGridBlockedCells kNavGridBlockedCells = makeNavGridBlockedCells();
+
 static Intensity calcIntensity(const Camera& camera, const StandardFixedTranslationVector& pos)
 {
     constexpr StandardFixedTranslationScalar kMaxDist = 32.f; // Will fade to 0 at this distance
@@ -131,27 +241,8 @@ static Intensity calcIntensity(const Camera& camera, const StandardFixedTranslat
 
 void Obstacles::Init()
 {
-    FixedTransform3D modelToWorld;
-    modelToWorld.setAsIdentity();
-    for(const ObstacleInstance& obstacle : kObstacles)
-    {
-        CollisionObject& collisionObject = Collisions::AllocateObject();
-        const ObstacleTypeDef& obstacleType = kObstacleTypeDefs[(int)obstacle.m_type];
-
-        modelToWorld.setTranslation(obstacle.m_position);
-        // Configure the collision object for tank collisions first
-        uint mask = (obstacleType.m_tankCollisionRadius == obstacleType.m_projectileCollisionRadius) ?
-                    kCollisionMaskTankObstacle | kCollisionMaskProjectileObstacle :
-                    kCollisionMaskTankObstacle;
-        collisionObject.Configure(modelToWorld, obstacleType.m_tankCollisionRadius, mask);
-        if((obstacleType.m_tankCollisionRadius != obstacleType.m_projectileCollisionRadius) && 
-           (obstacleType.m_projectileCollisionRadius > 0))
-        {
-            // Need a separate collision object for projectiles
-            CollisionObject& projectileCollisionObject = Collisions::AllocateObject();
-            projectileCollisionObject.Configure(modelToWorld, obstacleType.m_projectileCollisionRadius, kCollisionMaskProjectileObstacle, obstacleType.m_surfaceAngle);
-        }
-    }
+    Collisions::SetStaticObjects(kObstacleCollisionTable.GetIndex());
+    Navigation::SetBlockedCells(kNavGridBlockedCells);
 }
 
 void Obstacles::Draw(DisplayList& displayList, const Camera& camera)
@@ -19,22 +19,144 @@
 // oli.wright.github@gmail.com
 
 #include "particles.h"
-#include "extras/shapes3d.h"
 #include "spacetanks.h"
 #include "maths.h"
+#include "player.h"
+#include "collisions.h"
+#include "drawstate.h"
+#include <utility>
 
-static constexpr int kMaxParticles = 128;
+// The size of the particle pool.
+// This can be overridden by the build.
+#ifndef SPACETANKS_MAX_PARTICLES
+#    define SPACETANKS_MAX_PARTICLES 2048
+#endif
+static constexpr uint kMaxParticles = SPACETANKS_MAX_PARTICLES;
+static_assert(kMaxParticles <= 0xffff, "");
+
+// Every particle starts at the same brightness per tick of life, so longer
+// lived particles start brighter and they all fade to 0 at the same rate
+static constexpr StandardFixedTranslationScalar kBrightnessPerTick = 0.3f / (float) kTicksPerSecond;
 
 LogChannel s_particlesLog(false);
 
+// Build with SPACETANKS_VERIFY_PARTICLE_INTEGRATOR=1 to check the integrator
+// against the scalar reference version every tick
+#ifndef SPACETANKS_VERIFY_PARTICLE_INTEGRATOR
+#    define SPACETANKS_VERIFY_PARTICLE_INTEGRATOR 0
+#endif
+
+// Particle physics, in units per second
+static constexpr float kParticleGravityPerSecondSquared = 5.76f;
+static constexpr float kParticleDragPerSecond = 0.24f; //< The fraction of its speed a particle loses
+static constexpr float kMinParticleVelocityRange = 7.f; //< Fastest particle we need to be able to store
+
+// The same, per tick, for ParticleBase
+static constexpr float kParticleGravityPerTick = kParticleGravityPerSecondSquared * kPerSecondSquaredMultiplier;
+static constexpr float kParticleDragPerTick = kParticleDragPerSecond * (float) kPerSecondMultiplier;
+
+// Particle positions are 32-bit, because they need the range.
+// Velocities are packed into 16 bits.  They're stored in the raw units of
+// ParticleScalar shifted down by kParticleVelocityShift, which the slower tick
+// rates need so that a tick's worth of movement still fits.
+static constexpr int kParticleScalarFracBits = 20;
+typedef FixedPoint<11, kParticleScalarFracBits, int32_t, int64_t, false> ParticleScalar;
+typedef int32_t ParticlePosition;
+typedef int16_t ParticleVelocity;
+static constexpr int32_t kMaxParticleVelocity = 0x7fff;
+
+static constexpr int calcParticleVelocityShift()
+{
+    int shift = 0;
+    while(((float) (kMaxParticleVelocity << shift) / (float) (1 << kParticleScalarFracBits)) * (float) kTicksPerSecond < kMinParticleVelocityRange)
+    {
+        ++shift;
+    }
+    return shift;
+}
+static constexpr int kParticleVelocityShift = calcParticleVelocityShift();
+static constexpr int32_t kParticleVelocityScale = 1 << kParticleVelocityShift;
+
+// Drag is done with a shift rather than a multiply, so find the power of 2
+// nearest to the drag per tick
+static constexpr int calcParticleDragShift()
+{
+    int shift = 0;
+    while(((float) (1 << shift) * kParticleDragPerTick) < 0.7071f)
+    {
+        ++shift;
+    }
+    return shift;
+}
+
+// The integrator constants, in stored velocity units
+static constexpr int32_t kParticleGravity = (int32_t) ((kParticleGravityPerTick * (float) (1 << (kParticleScalarFracBits - kParticleVelocityShift))) + 0.5f);
+static constexpr int     kParticleDragShift = calcParticleDragShift(); //< v -= v >> kParticleDragShift
+static_assert(kParticleGravity > 0, "");
+
+// The number of particles integrated at a time
+static constexpr uint kIntegrateBatchSize = 64;
+
+// The particles are stored as a structure of arrays.
+// The live particles are packed into [0, s_numActiveParticles), and a
+// particle that dies is replaced by the last live one, so updating and
+// drawing only ever touch live particles.
+static ParticlePosition s_posX[kMaxParticles];
+static ParticlePosition s_posY[kMaxParticles];
+static ParticlePosition s_posZ[kMaxParticles];
+static ParticleVelocity s_velX[kMaxParticles];
+static ParticleVelocity s_velY[kMaxParticles];
+static ParticleVelocity s_velZ[kMaxParticles];
+static uint16_t         s_numTicksRemaining[kMaxParticles]; //< And the LOD bit
+static uint                           s_numActiveParticles = 0;
+// Alternates for each particle spawned, to pick which distant ones to draw
+static uint                           s_numSpawned = 0;
+
+static ParticleExhaustionPolicy s_exhaustionPolicy = ParticleExhaustionPolicy::Recycle;
+static uint                     s_recycleIdx = 0;
+static ParticlePoolStats        s_poolStats;
+static ParticleDrawStats        s_drawStats;
+
+// Obstacle collisions.
+// Particles hit the obstacles' full footprints, as tanks do, but pass over
+// the ones that are lower than they are.
+static bool s_obstacleCollisions = true;
+// The number of particles handed to Collisions::TestBatch at a time
+static constexpr uint kCollideBatchSize = 32;
+// Scratch space for collideWithObstacles.
+// Together these are a few KB, which is too much for the simulation core's stack.
+static uint16_t        s_collideIndices[kCollideBatchSize];
+static CollisionTester s_collideTests[kCollideBatchSize];
+static CollisionInfo   s_collideInfos[kCollideBatchSize];
+
+// Culling and LOD thresholds for Draw
+static constexpr uint kMinVisibleTicks = 8; //< Dimmer than this isn't worth drawing
+static constexpr StandardFixedTranslationScalar kMinParticleDepth = 0.1f;
+static constexpr StandardFixedTranslationScalar kParticleLODDepth = 16.f;
+static constexpr StandardFixedTranslationScalar kMaxParticleDepth = 32.f;
+// The top bit of s_numTicksRemaining says whether a particle is drawn beyond
+// kParticleLODDepth.  It's set when the particle spawns rather than taken from
+// its slot, because removing a particle moves another one into its slot.
+static constexpr uint16_t kParticleLODBit = 0x8000;
+static constexpr uint16_t kParticleTicksMask = kParticleLODBit - 1;
+
+// 1 / n for every lifetime a ParticleBase can have, so activating one doesn't need a divide
+struct ParticleLifeRecipTable
+{
+    StandardFixedTranslationScalar recip[ParticleBase::kMaxParticleBaseTicks + 1];
+};
+
+template<size_t... Is>
+static constexpr ParticleLifeRecipTable makeParticleLifeRecipTable(std::index_sequence<Is...>)
+{
+    return ParticleLifeRecipTable { { StandardFixedTranslationScalar((Is == 0) ? 0.f : (1.f / (float) Is))... } };
+}
+
+static constexpr ParticleLifeRecipTable kParticleLifeRecips = makeParticleLifeRecipTable(std::make_index_sequence<ParticleBase::kMaxParticleBaseTicks + 1>());
 
 ParticleBase::ParticleBase()
+: m_numTicksRemaining(0)
 {
-    m_numTicksRemaining = 0;
-    StandardFixedTranslationScalar relLife = StandardFixedTranslationScalar::randZeroToOne() * 0.75f + 0.25f;
-    m_startIntrinsicBrightness = relLife * 0.3f;
-    m_startTicks = (uint) (relLife * kFramesPerSecond);
-    m_recipTotalTicks = StandardFixedTranslationScalar(1.f) / StandardFixedTranslationScalar(m_startTicks);
 }
 
 void ParticleBase::Update()
@@ -44,21 +166,26 @@ void ParticleBase::Update()
         DeActivate();
         return;
     }
-    m_velocity.y -= 0.0001f;
-    m_velocity *= 0.999f;
+    m_velocity.y -= kParticleGravityPerTick;
+    m_velocity *= 1.f - kParticleDragPerTick;
     m_pos += m_velocity;
     if(m_pos.y < 0)
     {
         m_pos.y = 0;
         m_velocity *= StandardFixedTranslationVector(0.75f, -0.5f, 0.75f);
     }
-    m_intrinsicBrightness = m_recipTotalTicks * (int) m_numTicksRemaining * m_startIntrinsicBrightness;
+    m_intrinsicBrightness = m_brightnessPerTick * (int) m_numTicksRemaining;
 }
 
-void ParticleBase::Activate(const StandardFixedTranslationVector& pos, const StandardFixedTranslationVector& velocity)
+void ParticleBase::Activate(const StandardFixedTranslationVector& pos,
+                            const StandardFixedTranslationVector& velocity,
+                            uint numTicks,
+                            Intensity startBrightness)
 {
-    m_numTicksRemaining = m_startTicks;
-    m_intrinsicBrightness = m_startIntrinsicBrightness;
+    assert((numTicks > 0) && (numTicks <= kMaxParticleBaseTicks));
+    m_numTicksRemaining = numTicks;
+    m_intrinsicBrightness = startBrightness;
+    m_brightnessPerTick = startBrightness * kParticleLifeRecips.recip[numTicks];
     m_pos = pos;
     m_velocity = velocity;
 }
@@ -68,41 +195,508 @@ void ParticleBase::DeActivate()
     m_numTicksRemaining = false;
 }
 
-// An individual particle
-class Particle : public ParticleBase
+// Replace particle idx with the last live particle
+static inline void removeParticle(uint idx)
 {
-public:
-    void Draw(DisplayList& displayList, const Camera& camera) const
+    const uint last = --s_numActiveParticles;
+    s_posX[idx] = s_posX[last];
+    s_posY[idx] = s_posY[last];
+    s_posZ[idx] = s_posZ[last];
+    s_velX[idx] = s_velX[last];
+    s_velY[idx] = s_velY[last];
+    s_velZ[idx] = s_velZ[last];
+    s_numTicksRemaining[idx] = s_numTicksRemaining[last];
+}
+
+// Returns the slot for a new particle, or kMaxParticles if it should be dropped
+static inline uint allocateParticle()
+{
+    if(s_numActiveParticles < kMaxParticles)
     {
-        Shape3D::DrawPoint(displayList, m_pos, camera, m_intrinsicBrightness);
+        return s_numActiveParticles++;
     }
-};
+    if(s_exhaustionPolicy == ParticleExhaustionPolicy::Drop)
+    {
+        ++s_poolStats.numDropped;
+        return kMaxParticles;
+    }
+    // The pool is full, so every slot is live
+    ++s_poolStats.numRecycled;
+    const uint idx = s_recycleIdx;
+    s_recycleIdx = (idx + 1 < kMaxParticles) ? (idx + 1) : 0;
+    return idx;
+}
 
-static Particle s_particles[kMaxParticles];
+void Particles::Reset()
+{
+    s_numActiveParticles = 0;
+    s_numSpawned = 0;
+    s_recycleIdx = 0;
+    s_poolStats = ParticlePoolStats();
+    s_poolStats.capacity = kMaxParticles;
+}
 
+void Particles::SetExhaustionPolicy(ParticleExhaustionPolicy policy)
+{
+    s_exhaustionPolicy = policy;
+}
 
-void Particles::Reset()
+const ParticlePoolStats& Particles::GetPoolStats()
+{
+    s_poolStats.numActive = s_numActiveParticles;
+    return s_poolStats;
+}
+
+static inline ParticlePosition toParticlePosition(StandardFixedTranslationScalar v)
+{
+    return ParticleScalar(v).getStorage();
+}
+
+static inline ParticleVelocity clampParticleVelocity(int32_t raw)
+{
+    raw = (raw > kMaxParticleVelocity) ? kMaxParticleVelocity : raw;
+    raw = (raw < -kMaxParticleVelocity) ? -kMaxParticleVelocity : raw;
+    return (ParticleVelocity) raw;
+}
+
+// Velocities from raw ParticleScalar units to stored units and back
+static inline ParticleVelocity packParticleVelocity(int32_t raw)
+{
+    return clampParticleVelocity(raw >> kParticleVelocityShift);
+}
+
+static inline int32_t unpackParticleVelocity(ParticleVelocity v)
+{
+    return (int32_t) v * kParticleVelocityScale;
+}
+
+static inline ParticleVelocity toParticleVelocity(StandardFixedTranslationScalar v)
+{
+    return packParticleVelocity(ParticleScalar(v).getStorage());
+}
+
+static inline StandardFixedTranslationScalar fromParticleScalar(int32_t raw)
+{
+    return (StandardFixedTranslationScalar) ParticleScalar((ParticleScalar::StorageType) raw);
+}
+
+static inline StandardFixedTranslationScalar fromParticleVelocity(ParticleVelocity v)
+{
+    return fromParticleScalar(unpackParticleVelocity(v));
+}
+
+// Apply gravity, drag and the ground bounce, and move the particles.
+// There are no branches, and the only multiply is by kParticleVelocityScale,
+// which is a power of 2.  Each array is walked in order, so this vectorises
+// on the host. On the RP2040 it's just shifts and adds.
+static void integrate(ParticlePosition* __restrict posX,
+                      ParticlePosition* __restrict posY,
+                      ParticlePosition* __restrict posZ,
+                      ParticleVelocity* __restrict velX,
+                      ParticleVelocity* __restrict velY,
+                      ParticleVelocity* __restrict velZ,
+                      uint count)
+{
+    for(uint i = 0; i < count; ++i)
+    {
+        int32_t vx = velX[i];
+        int32_t vy = velY[i] - kParticleGravity;
+        int32_t vz = velZ[i];
+        vx -= vx >> kParticleDragShift;
+        vy -= vy >> kParticleDragShift;
+        vz -= vz >> kParticleDragShift;
+        const int32_t px = posX[i] + (vx * kParticleVelocityScale);
+        int32_t py = posY[i] + (vy * kParticleVelocityScale);
+        const int32_t pz = posZ[i] + (vz * kParticleVelocityScale);
+
+        // All ones if we've gone through the ground, otherwise all zeros
+        const int32_t bounce = py >> 31;
+        py &= ~bounce;
+        vx -= (vx >> 2) & bounce;                        //< * 0.75
+        vy = (vy & ~bounce) | (-(vy >> 1) & bounce);     //< * -0.5
+        vz -= (vz >> 2) & bounce;                        //< * 0.75
+        // Gravity can build up more speed than we can store
+        vy = (vy < -kMaxParticleVelocity) ? -kMaxParticleVelocity : vy;
+
+        posX[i] = px;
+        posY[i] = py;
+        posZ[i] = pz;
+        velX[i] = (ParticleVelocity) vx;
+        velY[i] = (ParticleVelocity) vy;
+        velZ[i] = (ParticleVelocity) vz;
+    }
+}
+
+#if SPACETANKS_VERIFY_PARTICLE_INTEGRATOR
+// The straightforward version of integrate, using fixed-point maths for
+// everything, to check it against
+static void integrateReference(ParticlePosition* posX,
+                               ParticlePosition* posY,
+                               ParticlePosition* posZ,
+                               ParticleVelocity* velX,
+                               ParticleVelocity* velY,
+                               ParticleVelocity* velZ,
+                               uint count)
+{
+    for(uint i = 0; i < count; ++i)
+    {
+        ParticleScalar px = ParticleScalar((ParticleScalar::StorageType) posX[i]);
+        ParticleScalar py = ParticleScalar((ParticleScalar::StorageType) posY[i]);
+        ParticleScalar pz = ParticleScalar((ParticleScalar::StorageType) posZ[i]);
+        ParticleScalar vx = ParticleScalar((ParticleScalar::StorageType) unpackParticleVelocity(velX[i]));
+        ParticleScalar vy = ParticleScalar((ParticleScalar::StorageType) unpackParticleVelocity(velY[i]));
+        ParticleScalar vz = ParticleScalar((ParticleScalar::StorageType) unpackParticleVelocity(velZ[i]));
+        // Drag with the factor that integrate's shift gives, because we're
+        // checking the integer maths rather than how close the shift gets
+        constexpr float kDrag = 1.f - (1.f / (float) (1 << kParticleDragShift));
+        vy -= kParticleGravityPerTick;
+        vx *= kDrag;
+        vy *= kDrag;
+        vz *= kDrag;
+        px += vx;
+        py += vy;
+        pz += vz;
+        if(py < 0)
+        {
+            py = 0;
+            vx *= 0.75f;
+            vy *= -0.5f;
+            vz *= 0.75f;
+        }
+        posX[i] = px.getStorage();
+        posY[i] = py.getStorage();
+        posZ[i] = pz.getStorage();
+        velX[i] = packParticleVelocity(vx.getStorage());
+        velY[i] = packParticleVelocity(vy.getStorage());
+        velZ[i] = packParticleVelocity(vz.getStorage());
+    }
+}
+
+static inline int32_t maxError(int32_t a0, int32_t b0, int32_t a1, int32_t b1, int32_t a2, int32_t b2)
 {
-    for(Particle& particle : s_particles)
+    const int32_t e0 = Abs(a0 - b0);
+    const int32_t e1 = Abs(a1 - b1);
+    const int32_t e2 = Abs(a2 - b2);
+    const int32_t e01 = (e0 > e1) ? e0 : e1;
+    return (e01 > e2) ? e01 : e2;
+}
+
+// Integrate a batch both ways and check they agree to within a few of the
+// smallest steps of each value.  Positions move in steps of the velocity scale.
+static void verifyIntegrate(uint first, uint count)
+{
+    constexpr int32_t kVelocityTolerance = 4;
+    constexpr int32_t kPositionTolerance = kVelocityTolerance * kParticleVelocityScale;
+    ParticlePosition posX[kIntegrateBatchSize], posY[kIntegrateBatchSize], posZ[kIntegrateBatchSize];
+    ParticleVelocity velX[kIntegrateBatchSize], velY[kIntegrateBatchSize], velZ[kIntegrateBatchSize];
+    for(uint i = 0; i < count; ++i)
     {
-        if(particle.IsActive()) particle.DeActivate();
+        posX[i] = s_posX[first + i];
+        posY[i] = s_posY[first + i];
+        posZ[i] = s_posZ[first + i];
+        velX[i] = s_velX[first + i];
+        velY[i] = s_velY[first + i];
+        velZ[i] = s_velZ[first + i];
+    }
+    integrateReference(posX, posY, posZ, velX, velY, velZ, count);
+    integrate(s_posX + first, s_posY + first, s_posZ + first, s_velX + first, s_velY + first, s_velZ + first, count);
+    for(uint i = 0; i < count; ++i)
+    {
+        const uint idx = first + i;
+        const int32_t posError = maxError(posX[i], s_posX[idx], posY[i], s_posY[idx], posZ[i], s_posZ[idx]);
+        const int32_t velError = maxError(velX[i], s_velX[idx], velY[i], s_velY[idx], velZ[i], s_velZ[idx]);
+        if((posError > kPositionTolerance) || (velError > kVelocityTolerance))
+        {
+            LOG_INFO(s_particlesLog, "Particle %d integrator error %d (position), %d (velocity)\n", idx, posError, velError);
+        }
+        assert((posError <= kPositionTolerance) && (velError <= kVelocityTolerance));
+    }
+}
+#endif
+
+void Particles::SetObstacleCollisions(bool enable)
+{
+    s_obstacleCollisions = enable;
+}
+
+// Bounce the first count particles in the scratch batch off whatever they hit
+static void collideBatch(uint count)
+{
+    if(Collisions::TestBatch(s_collideTests, count, false, s_collideInfos) == 0)
+    {
+        return;
+    }
+    for(uint i = 0; i < count; ++i)
+    {
+        const CollisionInfo& collisionInfo = s_collideInfos[i];
+        if(collisionInfo.mask == 0)
+        {
+            continue;
+        }
+        const uint idx = s_collideIndices[i];
+        const StandardFixedTranslationVector velocity(fromParticleVelocity(s_velX[idx]), fromParticleVelocity(s_velY[idx]), fromParticleVelocity(s_velZ[idx]));
+        const StandardFixedOrientationVector& normal = collisionInfo.normal;
+        const StandardFixedTranslationScalar alongNormal = (velocity.x * normal.x) + (velocity.y * normal.y) + (velocity.z * normal.z);
+        if(alongNormal >= 0)
+        {
+            // Already heading away, like sparks that were just spawned on the surface
+            continue;
+        }
+        // Put it back on the surface, and reflect the velocity about the
+        // normal, losing half of it
+        s_posX[idx] = toParticlePosition(collisionInfo.pos.x);
+        s_posZ[idx] = toParticlePosition(collisionInfo.pos.z);
+        s_velX[idx] = toParticleVelocity((velocity.x - (alongNormal * normal.x * 2)) * 0.5f);
+        s_velY[idx] = toParticleVelocity((velocity.y - (alongNormal * normal.y * 2)) * 0.5f);
+        s_velZ[idx] = toParticleVelocity((velocity.z - (alongNormal * normal.z * 2)) * 0.5f);
+    }
+}
+
+// Find the particles that could have hit an obstacle this tick, and test
+// them against the collision world in batches
+static void collideWithObstacles()
+{
+    uint count = 0;
+    // Particles above the tallest obstacle can't hit anything
+    const ParticlePosition maxHeight = toParticlePosition(Collisions::GetMaxStaticObjectTop());
+    for(uint idx = 0; idx < s_numActiveParticles; ++idx)
+    {
+        if(s_posY[idx] >= maxHeight)
+        {
+            continue;
+        }
+        const StandardFixedTranslationScalar x = fromParticleScalar(s_posX[idx]);
+        const StandardFixedTranslationScalar z = fromParticleScalar(s_posZ[idx]);
+        if(!Collisions::MayHitStaticObject(x, z, kCollisionMaskTankObstacle))
+        {
+            continue;
+        }
+        const StandardFixedTranslationVector pos(x, fromParticleScalar(s_posY[idx]), z);
+        const StandardFixedTranslationVector step(fromParticleVelocity(s_velX[idx]), 0, fromParticleVelocity(s_velZ[idx]));
+        s_collideIndices[count] = (uint16_t) idx;
+        s_collideTests[count] = CollisionTester(pos, step, 0, kCollisionMaskTankObstacle);
+        s_collideTests[count].SetHeight(pos.y);
+        if(++count == kCollideBatchSize)
+        {
+            collideBatch(count);
+            count = 0;
+        }
+    }
+    if(count > 0)
+    {
+        collideBatch(count);
     }
 }
 
 void Particles::Update()
 {
-    for(Particle& particle : s_particles)
+    for(uint first = 0; first < s_numActiveParticles; first += kIntegrateBatchSize)
+    {
+        const uint count = ((s_numActiveParticles - first) < kIntegrateBatchSize) ? (s_numActiveParticles - first) : kIntegrateBatchSize;
+#if SPACETANKS_VERIFY_PARTICLE_INTEGRATOR
+        verifyIntegrate(first, count);
+#else
+        integrate(s_posX + first, s_posY + first, s_posZ + first, s_velX + first, s_velY + first, s_velZ + first, count);
+#endif
+    }
+
+    if(s_obstacleCollisions)
+    {
+        collideWithObstacles();
+    }
+
+    // Now retire the particles that have run out of time
+    uint idx = 0;
+    while(idx < s_numActiveParticles)
+    {
+        if((--s_numTicksRemaining[idx] & kParticleTicksMask) == 0)
+        {
+            // Don't advance, because this slot now holds a different particle
+            removeParticle(idx);
+            continue;
+        }
+        ++idx;
+    }
+}
+
+const ParticleDrawStats& Particles::GetDrawStats()
+{
+    return s_drawStats;
+}
+
+void Particles::Capture(DrawState& drawState)
+{
+    // Reject as much as we can before handing anything to Shape3D, which
+    // does the full transform and projection when it's drawn.
+    // We only need the camera's axes for this, and we work relative to the
+    // camera so the numbers stay small.
+    const Camera& camera = drawState.camera;
+    const FixedTransform3D& cameraToWorld = camera.GetCameraToWorld();
+    const StandardFixedOrientationVector& right = cameraToWorld.m[0];
+    const StandardFixedOrientationVector& up = cameraToWorld.m[1];
+    const StandardFixedOrientationVector& forward = cameraToWorld.m[2];
+    const StandardFixedTranslationVector& cameraPos = camera.GetPosition();
+    // A little wider than the screen, so points on the edge don't pop
+    constexpr StandardFixedTranslationScalar kTanHalfCullFOV = Player::kTanHalfFOV * 1.1f;
+
+    s_drawStats = ParticleDrawStats();
+    s_drawStats.numConsidered = s_numActiveParticles;
+    for(uint idx = 0; idx < s_numActiveParticles; ++idx)
     {
-        if(particle.IsActive()) particle.Update();
+        const uint numTicksRemaining = s_numTicksRemaining[idx] & kParticleTicksMask;
+        if(numTicksRemaining < kMinVisibleTicks)
+        {
+            ++s_drawStats.numCulledFaint;
+            continue;
+        }
+        const StandardFixedTranslationVector pos(fromParticleScalar(s_posX[idx]), fromParticleScalar(s_posY[idx]), fromParticleScalar(s_posZ[idx]));
+        const StandardFixedTranslationVector relPos = pos - cameraPos;
+        const StandardFixedTranslationScalar depth = (relPos.x * forward.x) + (relPos.y * forward.y) + (relPos.z * forward.z);
+        if((depth < kMinParticleDepth) || (depth > kMaxParticleDepth))
+        {
+            ++s_drawStats.numCulledBehind;
+            continue;
+        }
+        const StandardFixedTranslationScalar halfExtent = depth * kTanHalfCullFOV;
+        const StandardFixedTranslationScalar x = (relPos.x * right.x) + (relPos.y * right.y) + (relPos.z * right.z);
+        const StandardFixedTranslationScalar y = (relPos.x * up.x) + (relPos.y * up.y) + (relPos.z * up.z);
+        if((Abs(x) > halfExtent) || (Abs(y) > halfExtent))
+        {
+            ++s_drawStats.numCulledOutside;
+            continue;
+        }
+        Intensity intensity = kBrightnessPerTick * (int) numTicksRemaining;
+        if(depth > kParticleLODDepth)
+        {
+            // Only draw half of the distant ones, but twice as bright
+            if(s_numTicksRemaining[idx] & kParticleLODBit)
+            {
+                ++s_drawStats.numCulledLOD;
+                continue;
+            }
+            intensity = intensity * 2;
+        }
+        if(!drawState.PushPoint(pos, intensity))
+        {
+            s_drawStats.numCulledFull += s_numActiveParticles - idx;
+            break;
+        }
+        ++s_drawStats.numDrawn;
     }
 }
 
-void Particles::Draw(DisplayList& displayList, const Camera& camera)
+// Emitters spawn bursts from a table of directions on the unit hemisphere
+// around +y, along with a random fraction of the emitter's life range.
+// Each burst starts at a random place in the table and then walks through it,
+// so there's just one random number per burst.
+struct ParticleSample
+{
+    int16_t x, y, z; //< Q14, so 1 is 0x4000
+    uint8_t life;    //< 0 to 255, for the fraction of the emitter's life range
+};
+static constexpr uint kNumParticleSamples = 256; // Must be a power of 2
+static constexpr int  kParticleSampleShift = 14;
+static_assert((kNumParticleSamples & (kNumParticleSamples - 1)) == 0, "");
+
+// Constexpr helpers for building the sample table
+static constexpr uint32_t sampleHash(uint32_t v)
+{
+    // A 32-bit integer hash, so each sample can be generated independently
+    v ^= v >> 16;
+    v *= 0x7feb352du;
+    v ^= v >> 15;
+    v *= 0x846ca68bu;
+    v ^= v >> 16;
+    return v;
+}
+
+static constexpr float sampleHashToMinusOneToOne(uint32_t v)
+{
+    return ((float) (v & 0xffff) / 32767.5f) - 1.f;
+}
+
+static constexpr float constexprSqrt(float v)
 {
-    for(const Particle& particle : s_particles)
+    float x = (v > 1.f) ? v : 1.f;
+    for(int i = 0; i < 16; ++i)
     {
-        if(particle.IsActive()) particle.Draw(displayList, camera);
+        x = 0.5f * (x + (v / x));
     }
+    return x;
+}
+
+static constexpr ParticleSample makeParticleSample(uint idx)
+{
+    // Pick points in the cube until one is in the unit sphere, and not too
+    // near the middle to normalise
+    for(uint32_t attempt = 0; ; ++attempt)
+    {
+        const uint32_t seed = (idx << 8) + attempt;
+        const float x = sampleHashToMinusOneToOne(sampleHash(seed * 3));
+        const float y = sampleHashToMinusOneToOne(sampleHash(seed * 3 + 1));
+        const float z = sampleHashToMinusOneToOne(sampleHash(seed * 3 + 2));
+        const float lengthSquared = (x * x) + (y * y) + (z * z);
+        if((lengthSquared > 1.f) || (lengthSquared < 0.01f))
+        {
+            continue;
+        }
+        const float scale = 16383.f / constexprSqrt(lengthSquared);
+        return ParticleSample {
+            (int16_t) (x * scale),
+            (int16_t) (((y < 0) ? -y : y) * scale), //< Fold into the upper hemisphere
+            (int16_t) (z * scale),
+            (uint8_t) (sampleHash(~seed) & 0xff) };
+    }
+}
+
+struct ParticleSampleTable
+{
+    ParticleSample samples[kNumParticleSamples];
+};
+
+template<size_t... Is>
+static constexpr ParticleSampleTable makeParticleSampleTable(std::index_sequence<Is...>)
+{
+    return ParticleSampleTable { { makeParticleSample((uint) Is)... } };
+}
+
+static constexpr ParticleSampleTable kParticleSamples = makeParticleSampleTable(std::make_index_sequence<kNumParticleSamples>());
+
+struct ParticleEmitterDef
+{
+    StandardFixedTranslationScalar tangentSpeed;   //< Per tick, across the surface
+    StandardFixedTranslationScalar normalSpeed;    //< Per tick, away from the surface
+    StandardFixedTranslationScalar impactFraction; //< How much of the impact velocity along the surface to keep
+    uint16_t                       minTicks;
+    uint16_t                       maxTicks;
+    uint16_t                       count;
+};
+
+static constexpr ParticleEmitterDef kParticleEmitterDefs[] =
+{
+    // tangentSpeed                            normalSpeed                                 impactFraction  minTicks                     maxTicks                   count
+    { 3.f * (float) kPerSecondMultiplier,       1.5f * (float) kPerSecondMultiplier,       0.25f,          (uint16_t) (int) (kTicksPerSecond * 0.25f),    (uint16_t) (int) (kTicksPerSecond * 1.f),    64 },  // ImpactSparks
+    { 1.f * (float) kPerSecondMultiplier,       0.5f * (float) kPerSecondMultiplier,       0,              (uint16_t) (int) (kTicksPerSecond * 0.5f),     (uint16_t) (int) (kTicksPerSecond * 1.5f),   24 },  // GroundDust
+    { 5.f * (float) kPerSecondMultiplier,       5.f * (float) kPerSecondMultiplier,        0,              (uint16_t) (int) (kTicksPerSecond * 0.5f),     (uint16_t) (int) (kTicksPerSecond * 2.f),    192 }, // TankExplosion
+};
+static_assert(count_of(kParticleEmitterDefs) == (size_t) ParticleEmitter::Count, "");
+
+static constexpr bool particleLivesFitInTicksMask()
+{
+    for(const ParticleEmitterDef& def : kParticleEmitterDefs)
+    {
+        if(def.maxTicks > kParticleTicksMask)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+static_assert(particleLivesFitInTicksMask(), "");
+
+static StandardFixedOrientationScalar dot(const StandardFixedOrientationVector& a, const StandardFixedTranslationVector& b)
+{
+    return (a.x * b.x) + (a.y * b.y) + (a.z * b.z);
 }
 
 static void normalise(StandardFixedOrientationVector& vec)
@@ -112,52 +706,110 @@ static void normalise(StandardFixedOrientationVector& vec)
     vec *= recipLength;
 }
 
-void Particles::Spawn(const StandardFixedTranslationVector& pos,
+// The components of a scaled basis vector, in stored velocity units.
+// Those are shifted to suit the tick rate, so as long as the emitter speeds
+// fit in a ParticleVelocity, the products with the samples fit in 32 bits.
+struct ParticleBasisAxis
+{
+    int32_t x, y, z;
+
+    ParticleBasisAxis(const StandardFixedOrientationVector& axis, StandardFixedTranslationScalar scale)
+    : x(ParticleScalar(scale * axis.x).getStorage() >> kParticleVelocityShift)
+    , y(ParticleScalar(scale * axis.y).getStorage() >> kParticleVelocityShift)
+    , z(ParticleScalar(scale * axis.z).getStorage() >> kParticleVelocityShift)
+    {}
+};
+
+// Three products of a speed and a sample, each no bigger than
+// kMaxParticleVelocity * 16383, must add up without overflowing
+static_assert((3ll * kMaxParticleVelocity * (1 << kParticleSampleShift)) <= INT32_MAX, "");
+
+static constexpr bool particleSpeedsFitInVelocities()
+{
+    constexpr float kStoredVelocityScale = (float) (1 << (kParticleScalarFracBits - kParticleVelocityShift));
+    for(const ParticleEmitterDef& def : kParticleEmitterDefs)
+    {
+        if((((float) def.tangentSpeed * kStoredVelocityScale) > (float) kMaxParticleVelocity) ||
+           (((float) def.normalSpeed * kStoredVelocityScale) > (float) kMaxParticleVelocity))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+static_assert(particleSpeedsFitInVelocities(), "");
+
+void Particles::Spawn(ParticleEmitter emitter,
+                      const StandardFixedTranslationVector& pos,
                       const StandardFixedOrientationVector& normal,
-                      const StandardFixedTranslationVector& impactVelocity,
-                      int count)
+                      const StandardFixedTranslationVector& impactVelocity)
 {
-    // Create a basis matrix for spawnage
+    const ParticleEmitterDef& def = kParticleEmitterDefs[(uint) emitter];
+    int count = def.count;
+
+    // Create a basis for spawnage, once per burst.
     // The y axis will align with the normal, and we don't care about the order
     // or sign of the x and z axes, as long as they're normalish and perpendicular.
-    FixedTransform3D particleSpawnToWorld;
-    particleSpawnToWorld.markAsManuallyManipulated();
-    particleSpawnToWorld.m[1] = normal;
-    particleSpawnToWorld.m[0] = cross(normal, StandardFixedOrientationVector(0, 1, 0));
-    normalise(particleSpawnToWorld.m[0]);
-    particleSpawnToWorld.m[2] = cross(normal, particleSpawnToWorld.m[0]);
-    particleSpawnToWorld.t = pos;
-    LOG_INFO(s_particlesLog, "\n%f, %f, %f\n", (float) particleSpawnToWorld.m[0].x, (float) particleSpawnToWorld.m[0].y, (float) particleSpawnToWorld.m[0].z);
-    LOG_INFO(s_particlesLog, "%f, %f, %f\n", (float) particleSpawnToWorld.m[1].x, (float) particleSpawnToWorld.m[1].y, (float) particleSpawnToWorld.m[1].z);
-    LOG_INFO(s_particlesLog, "%f, %f, %f\n", (float) particleSpawnToWorld.m[2].x, (float) particleSpawnToWorld.m[2].y, (float) particleSpawnToWorld.m[2].z);
+    // Cross with whichever of y and x is less parallel to the normal.
+    const StandardFixedOrientationVector other = (Abs(normal.y) < 0.9f) ? StandardFixedOrientationVector(0, 1, 0) : StandardFixedOrientationVector(1, 0, 0);
+    StandardFixedOrientationVector tangent0 = cross(normal, other);
+    normalise(tangent0);
+    const StandardFixedOrientationVector tangent1 = cross(normal, tangent0);
     LOG_INFO(s_particlesLog, "Pos: %f, %f, %f\n", (float) pos.x, (float) pos.y, (float) pos.z);
     LOG_INFO(s_particlesLog, "Vel: %f, %f, %f\n", (float) impactVelocity.x, (float) impactVelocity.y, (float) impactVelocity.z);
 
-    // Transform the impact velocity vector into particle spawn space
-    FixedTransform3D worldToParticleSpawn;
-    particleSpawnToWorld.orthonormalInvert(worldToParticleSpawn);
+    // Keep some of the impact velocity along the surface.
+    // Taking out the part along the normal is the same as transforming into
+    // spawn space and zeroing y, without needing the inverse.
+    StandardFixedTranslationVector baseVelocity(0, 0, 0);
+    if(def.impactFraction > 0)
+    {
+        const StandardFixedTranslationScalar alongNormal = (StandardFixedTranslationScalar) dot(normal, impactVelocity);
+        baseVelocity.x = (impactVelocity.x - (alongNormal * normal.x)) * def.impactFraction;
+        baseVelocity.y = (impactVelocity.y - (alongNormal * normal.y)) * def.impactFraction;
+        baseVelocity.z = (impactVelocity.z - (alongNormal * normal.z)) * def.impactFraction;
+    }
+    const int32_t baseX = packParticleVelocity(ParticleScalar(baseVelocity.x).getStorage());
+    const int32_t baseY = packParticleVelocity(ParticleScalar(baseVelocity.y).getStorage());
+    const int32_t baseZ = packParticleVelocity(ParticleScalar(baseVelocity.z).getStorage());
 
-    StandardFixedTranslationVector spawnVelocitySpawnSpace;
-    worldToParticleSpawn.rotateVector(spawnVelocitySpawnSpace, impactVelocity);
-    spawnVelocitySpawnSpace.y = 0;
+    // Fold the emitter's speeds into the basis, so each particle is just
+    // three integer multiply-adds per component
+    const ParticleBasisAxis axisX(tangent0, def.tangentSpeed);
+    const ParticleBasisAxis axisY(normal, def.normalSpeed);
+    const ParticleBasisAxis axisZ(tangent1, def.tangentSpeed);
+    const ParticlePosition posX = toParticlePosition(pos.x);
+    const ParticlePosition posY = toParticlePosition(pos.y);
+    const ParticlePosition posZ = toParticlePosition(pos.z);
+    const uint rangeTicks = def.maxTicks - def.minTicks;
 
-    for(Particle& particle : s_particles)
+    if((s_numActiveParticles + count > kMaxParticles) && (s_exhaustionPolicy == ParticleExhaustionPolicy::Drop))
+    {
+        // Don't bother making particles that won't fit
+        const int numToDrop = (int) (s_numActiveParticles + count) - (int) kMaxParticles;
+        s_poolStats.numDropped += numToDrop;
+        count -= numToDrop;
+    }
+    uint sampleIdx = (uint) (StandardFixedTranslationScalar::randZeroToOne() * (int) kNumParticleSamples);
+    for(; count > 0; --count)
     {
-        if(!particle.IsActive())
+        const uint idx = allocateParticle();
+        if(idx == kMaxParticles)
         {
-            // Create a particle
-            StandardFixedTranslationVector velocity;
-            velocity.x = StandardFixedTranslationScalar::randMinusOneToOne();
-            velocity.y = StandardFixedTranslationScalar::randZeroToOne() * 0.5f;
-            velocity.z = StandardFixedTranslationScalar::randMinusOneToOne();
-            velocity *= kPerSecondMultiplier * 3.f;
-            velocity += spawnVelocitySpawnSpace * 0.25f; // Use a fraction of the impact velocity
-            StandardFixedTranslationVector velocityWorldSpace;
-            particleSpawnToWorld.rotateVector(velocityWorldSpace, velocity);
-            LOG_INFO(s_particlesLog, "VelWS: %f, %f, %f\n", (float) velocityWorldSpace.x, (float) velocityWorldSpace.y, (float) velocityWorldSpace.z);
-            particle.Activate(pos, velocityWorldSpace);
-            if(--count == 0) break;
+            break;
         }
+        const ParticleSample& sample = kParticleSamples.samples[sampleIdx++ & (kNumParticleSamples - 1)];
+        s_posX[idx] = posX;
+        s_posY[idx] = posY;
+        s_posZ[idx] = posZ;
+        s_velX[idx] = clampParticleVelocity(baseX + (((axisX.x * sample.x) + (axisY.x * sample.y) + (axisZ.x * sample.z)) >> kParticleSampleShift));
+        s_velY[idx] = clampParticleVelocity(baseY + (((axisX.y * sample.x) + (axisY.y * sample.y) + (axisZ.y * sample.z)) >> kParticleSampleShift));
+        s_velZ[idx] = clampParticleVelocity(baseZ + (((axisX.z * sample.x) + (axisY.z * sample.y) + (axisZ.z * sample.z)) >> kParticleSampleShift));
+        const uint16_t lodBit = (s_numSpawned++ & 1) ? kParticleLODBit : 0;
+        s_numTicksRemaining[idx] = (uint16_t) (def.minTicks + ((rangeTicks * sample.life) >> 8)) | lodBit;
+    }
+    if(s_numActiveParticles > s_poolStats.highWaterMark)
+    {
+        s_poolStats.highWaterMark = s_numActiveParticles;
     }
 }
-
@@ -22,21 +22,72 @@
 #include "picovectorscope.h"
 #include "extras/camera.h"
 
+struct DrawState;
+
+// Emitter presets for Particles::Spawn
+enum class ParticleEmitter
+{
+    ImpactSparks,  //< A projectile hitting something
+    GroundDust,    //< Kicked up from the ground
+    TankExplosion,
+
+    Count
+};
+
+// What to do when a particle is spawned and the pool is full
+enum class ParticleExhaustionPolicy
+{
+    Drop,    //< Don't spawn it
+    Recycle, //< Replace a live particle, cycling through the pool so the same ones aren't always replaced
+};
+
+struct ParticlePoolStats
+{
+    uint capacity      = 0;
+    uint numActive     = 0;
+    uint highWaterMark = 0; //< Most particles alive at once since Reset
+    uint numDropped    = 0;
+    uint numRecycled   = 0;
+};
+
+// What happened to the live particles in the last Capture
+struct ParticleDrawStats
+{
+    uint numConsidered   = 0;
+    uint numCulledFaint  = 0; //< Too dim to see
+    uint numCulledBehind = 0; //< Behind the camera or too far away
+    uint numCulledOutside = 0; //< Off the sides of the screen
+    uint numCulledLOD    = 0; //< Thinned out in the distance
+    uint numCulledFull   = 0; //< No room left in the DrawState
+    uint numDrawn        = 0;
+};
 
 // Static class to manage _all_ the particles
 class Particles
 {
 public:    
     static void Reset();
+    static void SetExhaustionPolicy(ParticleExhaustionPolicy policy);
+    static const ParticlePoolStats& GetPoolStats();
+    static const ParticleDrawStats& GetDrawStats();
+    // Whether particles bounce off obstacles as well as the ground.  On by default.
+    static void SetObstacleCollisions(bool enable);
     static void Update();
-    static void Draw(DisplayList& displayList, const Camera& camera);
+    // Cull the particles against the DrawState's camera, and add the visible ones
+    static void Capture(DrawState& drawState);
 
-    static void Spawn(const StandardFixedTranslationVector& pos,
+    // Spawn a burst of particles from an emitter preset.
+    // They fly out from the surface with the given normal, and keep some of
+    // the impact velocity along the surface if the preset asks for it.
+    static void Spawn(ParticleEmitter emitter,
+                      const StandardFixedTranslationVector& pos,
                       const StandardFixedOrientationVector& normal,
-                      const StandardFixedTranslationVector& impactVelocity,
-                      int count);
+                      const StandardFixedTranslationVector& impactVelocity = StandardFixedTranslationVector(0, 0, 0));
 };
 
+// A single particle that can be specialised, for things like debris.
+// Lifetime and brightness are given each time it's activated, so constructing
+// one costs nothing.
 class ParticleBase
 {
 public:
@@ -45,15 +96,19 @@ public:
     bool IsActive() const { return m_numTicksRemaining != 0; }
 
     void Update();
-    void Activate(const StandardFixedTranslationVector& pos, const StandardFixedTranslationVector& velocity);
+    // numTicks must be between 1 and kMaxParticleBaseTicks
+    void Activate(const StandardFixedTranslationVector& pos,
+                  const StandardFixedTranslationVector& velocity,
+                  uint numTicks,
+                  Intensity startBrightness);
     void DeActivate();
 
+    static constexpr uint kMaxParticleBaseTicks = 512;
+
 protected:
     StandardFixedTranslationVector m_pos;
     StandardFixedTranslationVector m_velocity;
     uint m_numTicksRemaining;
-    uint m_startTicks;
-    Intensity m_startIntrinsicBrightness;
     Intensity m_intrinsicBrightness;
-    StandardFixedTranslationScalar m_recipTotalTicks;
+    Intensity m_brightnessPerTick;
 };
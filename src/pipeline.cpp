@@ -0,0 +1,152 @@
+// Space Tanks simulation pipeline
+//
+//
+// Copyright (C) 2023 Oli Wright
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// A copy of the GNU General Public License can be found in the file
+// LICENSE.txt in the root of this project.
+// If not, see <https://www.gnu.org/licenses/>.
+//
+// oli.wright.github@gmail.com
+
+#include "pipeline.h"
+#include "drawstate.h"
+#include "simulation.h"
+#include "spacetanks.h"
+#include "spscqueue.h"
+#if defined(PICO_ON_DEVICE) && PICO_ON_DEVICE
+#    include "pico/multicore.h"
+#else
+#    include <thread>
+#endif
+
+// A DrawState on its way to be simulated, and how far to simulate it
+struct PipelineFrame
+{
+    DrawState* drawState;
+    float      dt;
+};
+
+// Two is enough to keep both sides busy
+static constexpr uint kNumDrawStates = 2;
+
+static DrawState s_drawStates[kNumDrawStates];
+static SpscQueue<PipelineFrame, kNumDrawStates> s_toSimulate; //< Drawing to simulation
+static SpscQueue<DrawState*, kNumDrawStates>    s_toDraw;     //< Simulation to drawing
+static DrawState* s_drawing = nullptr;
+
+static std::atomic<bool> s_stopRequested{false};
+static std::atomic<bool> s_stopped{true};
+#if !(defined(PICO_ON_DEVICE) && PICO_ON_DEVICE)
+static std::thread s_simulationThread;
+#endif
+
+LogChannel s_pipelineLog(false);
+
+// Called while spinning on the other side
+static void waitForOtherSide()
+{
+#if defined(PICO_ON_DEVICE) && PICO_ON_DEVICE
+    tight_loop_contents();
+#else
+    // There might not be a spare hardware thread on the host
+    std::this_thread::yield();
+#endif
+}
+
+// This is all the other core does
+static void simulate()
+{
+    PipelineFrame frame;
+    while(!s_stopRequested.load(std::memory_order_acquire))
+    {
+        if(!s_toSimulate.Pop(frame))
+        {
+            waitForOtherSide();
+            continue;
+        }
+        Simulation::Advance(frame.dt);
+        Simulation::Capture(*frame.drawState);
+        // This can't fail, because there are only kNumDrawStates to go round
+        const bool pushed = s_toDraw.Push(frame.drawState);
+        assert(pushed);
+        (void) pushed;
+    }
+    s_stopped.store(true, std::memory_order_release);
+}
+
+void Pipeline::Start()
+{
+    assert(!IsRunning());
+    s_toSimulate.Reset();
+    s_toDraw.Reset();
+    s_drawing = nullptr;
+    // Get both DrawStates simulating straight away, a frame apart
+    const float dt = 1.f / (float) kFramesPerSecond;
+    for(DrawState& drawState : s_drawStates)
+    {
+        s_toSimulate.Push(PipelineFrame { &drawState, dt });
+    }
+    s_stopRequested.store(false, std::memory_order_relaxed);
+    s_stopped.store(false, std::memory_order_release);
+    LOG_INFO(s_pipelineLog, "Pipeline starting\n");
+#if defined(PICO_ON_DEVICE) && PICO_ON_DEVICE
+    multicore_launch_core1(simulate);
+#else
+    s_simulationThread = std::thread(simulate);
+#endif
+}
+
+void Pipeline::Stop()
+{
+    if(!IsRunning())
+    {
+        return;
+    }
+    s_stopRequested.store(true, std::memory_order_release);
+#if defined(PICO_ON_DEVICE) && PICO_ON_DEVICE
+    while(!s_stopped.load(std::memory_order_acquire))
+    {
+        waitForOtherSide();
+    }
+    multicore_reset_core1();
+#else
+    s_simulationThread.join();
+#endif
+    LOG_INFO(s_pipelineLog, "Pipeline stopped\n");
+}
+
+bool Pipeline::IsRunning()
+{
+    return !s_stopped.load(std::memory_order_acquire);
+}
+
+const DrawState& Pipeline::BeginDraw()
+{
+    assert(s_drawing == nullptr);
+    while(!s_toDraw.Pop(s_drawing))
+    {
+        waitForOtherSide();
+    }
+    return *s_drawing;
+}
+
+void Pipeline::EndDraw(float dt)
+{
+    assert(s_drawing != nullptr);
+    // This can't fail either
+    const bool pushed = s_toSimulate.Push(PipelineFrame { s_drawing, dt });
+    assert(pushed);
+    (void) pushed;
+    s_drawing = nullptr;
+}
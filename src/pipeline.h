@@ -0,0 +1,45 @@
+// Space Tanks simulation pipeline
+//
+//
+// Copyright (C) 2023 Oli Wright
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// A copy of the GNU General Public License can be found in the file
+// LICENSE.txt in the root of this project.
+// If not, see <https://www.gnu.org/licenses/>.
+//
+// oli.wright.github@gmail.com
+
+#pragma once
+#include "picovectorscope.h"
+
+struct DrawState;
+
+// Runs the simulation on the other core (or a thread, on the host), so that
+// the next frame is simulated while this one's display list is being built.
+// The two sides pass a pair of DrawStates back and forth through lock-free
+// queues, so neither ever looks at a DrawState the other is using.
+class Pipeline
+{
+public:
+    // Start simulating on the other core.  The simulation must already be Reset.
+    static void Start();
+    // Stop simulating, and wait for the other core to finish its frame.
+    // Does nothing if it's not running.
+    static void Stop();
+    static bool IsRunning();
+
+    // Wait for the next simulated frame to draw
+    static const DrawState& BeginDraw();
+    // Hand the frame back to be simulated again, dt seconds on from the last one
+    static void EndDraw(float dt);
+};
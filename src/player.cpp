@@ -22,12 +22,15 @@
 #include "spacetanks.h"
 #include "projectiles.h"
 #include "collisions.h"
+#include "simulation.h"
+#include "drawstate.h"
 
 // Constants
 static constexpr Angle kRotationSpeed = 1.0f * (float) kPerSecondMultiplier;
-static constexpr Angle kRotationAcceleration = 0.01f * (float) kPerSecondMultiplier;;
+static constexpr Angle kRotationAcceleration = 2.4f * kPerSecondSquaredMultiplier;
 static constexpr StandardFixedTranslationScalar kTranslationSpeed = 2.5f * (float) kPerSecondMultiplier;
-static constexpr StandardFixedTranslationScalar kAcceleration = 0.02f * (float) kPerSecondMultiplier;
+static constexpr StandardFixedTranslationScalar kAcceleration = 4.8f * kPerSecondSquaredMultiplier;
+static constexpr StandardFixedTranslationScalar kCollisionRadius = 0.3f;
 
 // Module scoped static variables
 static Angle   s_yaw;
@@ -35,9 +38,13 @@ static Angle   s_yawSpeed;
 static StandardFixedTranslationVector   s_position;
 static StandardFixedTranslationVector   s_velocity;
 static StandardFixedTranslationScalar   s_speed;
+static CollisionObject*                 s_collisionObject;
+static bool                             s_fireWasHeld;
+static StandardFixedOrientationVector   s_forward;
 
-// Class scoped static variables
-Camera                         Player::s_camera;
+// Where we were at the end of the previous tick, for drawing in between
+static Angle                            s_prevYaw;
+static StandardFixedTranslationVector   s_prevPosition;
 
 LogChannel s_playerLog(true);
 
@@ -45,10 +52,21 @@ void Player::Reset()
 {
     s_position = StandardFixedTranslationVector(4,0.5f,0);
     s_yaw = kPi * 1.5f;
+    s_prevPosition = s_position;
+    s_prevYaw = s_yaw;
+    s_fireWasHeld = false;
+    FixedTransform3D viewToWorld;
+    viewToWorld.setRotationXYZ(0, (SinTable::Index) s_yaw, 0);
+    s_forward = viewToWorld.m[2];
+    // Collisions::Reset has already freed the old one
+    s_collisionObject = Collisions::AllocateObject();
 }
 
 void Player::Update()
 {
+    s_prevPosition = s_position;
+    s_prevYaw = s_yaw;
+
     // Handle the rotate left and y buttons
     bool dampYaw = true;
     if(Buttons::IsHeld(Buttons::Id::Left))
@@ -83,6 +101,7 @@ void Player::Update()
     // Construct the rotation part of the viewToWorld transform
     FixedTransform3D viewToWorld;
     viewToWorld.setRotationXYZ(0, (SinTable::Index) s_yaw, 0);
+    s_forward = viewToWorld.m[2];
 
     // Handle the drive button
     if(Buttons::IsHeld(Buttons::Id::Thrust))
@@ -104,13 +123,26 @@ void Player::Update()
         }
     }
     s_velocity = (StandardFixedTranslationVector)viewToWorld.m[2] * s_speed;
-    s_position += s_velocity;
+    s_position = Collisions::Slide(s_position,
+                                   s_velocity,
+                                   kCollisionRadius,
+                                   kCollisionMaskTankObstacle | kCollisionMaskEnemy,
+                                   s_collisionObject);
     s_position.y = 0.625f;
 
     // Set the translation part of the viewToWorld transform
     viewToWorld.setTranslation(s_position);
+    if(s_collisionObject != nullptr)
+    {
+        s_collisionObject->Configure(viewToWorld, kCollisionRadius, kCollisionMaskPlayer);
+    }
 
-    if(Buttons::IsJustPressed(Buttons::Id::Fire) && !Projectiles::IsActive(0))
+    // Ticks don't line up with frames, so look for the press ourselves rather
+    // than relying on IsJustPressed, which could be missed or seen twice
+    const bool fireHeld = Buttons::IsHeld(Buttons::Id::Fire);
+    const bool firePressed = fireHeld && !s_fireWasHeld;
+    s_fireWasHeld = fireHeld;
+    if(firePressed && !Projectiles::IsActive(0))
     {
         // Camera is z into the screen, but tanks are x forward
         FixedTransform3D modelToWorld;
@@ -125,10 +157,38 @@ void Player::Update()
         Projectiles::Create(0, modelToWorld, kCollisionMaskProjectileObstacle | kCollisionMaskEnemy);
     }
 
-    // Update the camera
-    s_camera.SetCameraToWorld(viewToWorld);
-    s_camera.SetTanHalfVerticalFOV(0.5f);
-    s_camera.Calculate();
+}
+
+void Player::Capture(DrawState& drawState)
+{
+    const StandardFixedTranslationScalar tickFraction = Simulation::GetTickFraction();
+
+    // Take the short way round
+    Angle yawDiff = s_yaw - s_prevYaw;
+    if(yawDiff > kPi) yawDiff -= k2Pi;
+    else if(yawDiff < -kPi) yawDiff += k2Pi;
+    Angle yaw = s_prevYaw + (yawDiff * (Angle) tickFraction);
+    if(yaw < 0) yaw += k2Pi;
+    if(yaw > k2Pi) yaw -= k2Pi;
+
+    FixedTransform3D viewToWorld;
+    viewToWorld.setRotationXYZ(0, (SinTable::Index) yaw, 0);
+    viewToWorld.setTranslation(s_prevPosition + ((s_position - s_prevPosition) * tickFraction));
+
+    Camera& camera = drawState.camera;
+    camera.SetCameraToWorld(viewToWorld);
+    camera.SetTanHalfVerticalFOV(kTanHalfFOV);
+    camera.Calculate();
+}
+
+const StandardFixedTranslationVector& Player::GetPosition()
+{
+    return s_position;
+}
+
+const StandardFixedOrientationVector& Player::GetForward()
+{
+    return s_forward;
 }
 
 void Player::Draw(DisplayList& displayList)
@@ -22,16 +22,22 @@
 #include "picovectorscope.h"
 #include "extras/camera.h"
 
+struct DrawState;
+
 class Player
 {
 public:
+    // The camera's field of view. The display is square, so this is horizontal too.
+    static constexpr float kTanHalfFOV = 0.5f;
+
     static void Reset();
     static void Update();
     static void Draw(DisplayList& displayList);
 
-    static const Camera& GetCamera() { return s_camera; }
-    static const StandardFixedTranslationVector& GetPosition() { return s_camera.GetPosition(); }
-    
-private:
-    static Camera                    s_camera;
+    // Place the camera between the last two ticks, ready for drawing
+    static void Capture(DrawState& drawState);
+
+    static const StandardFixedTranslationVector& GetPosition();
+    // The way the player is facing, as of the last tick
+    static const StandardFixedOrientationVector& GetForward();
 };
@@ -24,10 +24,11 @@
 #include "collisions.h"
 #include "particles.h"
 #include "enemytanks.h"
+#include "simulation.h"
+#include "drawstate.h"
 
-static constexpr int kMaxProjectiles = 5;
 static constexpr StandardFixedTranslationScalar kTranslationSpeed = 8.f * (float) kPerSecondMultiplier;
-static constexpr int kLifeTicks = (int) (kFramesPerSecond * 1.5f);
+static constexpr int kLifeTicks = (int) (kTicksPerSecond * 1.5f);
 
 static int s_numActiveProjectiles = 0;
 
@@ -37,38 +38,46 @@ class Projectile
 public:
     bool IsActive() const { return m_active; }
 
-    void Update()
+    // Returns true if the projectile is still active, and needs testing for collisions
+    bool Update()
     {
         if(--m_numTicksRemaining == 0)
         {
             DeActivate();
-            return;
+            return false;
         }
         m_modelToWorld.translate(m_stepWorldSpace);
-        CollisionTester collisionTester(m_modelToWorld.t, m_stepWorldSpace, 0.01f, m_collisionMask);
-        CollisionInfo collisionInfo;
-        if(Collisions::Test(collisionTester, false/*justDoCircles*/, &collisionInfo))
+        return true;
+    }
+
+    CollisionTester GetCollisionTester() const
+    {
+        return CollisionTester(m_modelToWorld.t, m_stepWorldSpace, 0.01f, m_collisionMask);
+    }
+
+    void OnCollision(CollisionInfo& collisionInfo)
+    {
+        DeActivate();
+        const uint collisionObjectMask = collisionInfo.mask;
+        if((collisionObjectMask & (kCollisionMaskProjectileObstacle | kCollisionMaskEnemy)) != 0)
         {
-            DeActivate();
-            const uint collisionObjectMask = collisionInfo.object->GetMask();
-            if((collisionObjectMask & (kCollisionMaskProjectileObstacle | kCollisionMaskEnemy)) != 0)
-            {
-                collisionInfo.pos.y = m_modelToWorld.t.y;
-                Particles::Spawn(collisionInfo.pos, collisionInfo.normal, m_stepWorldSpace, 64);
-            }
-            if(collisionObjectMask & kCollisionMaskEnemy)
-            {
-                // This is a poor separation of concerns.
-                // But it's a simple enough game - so meh.
-                EnemyTanks::Destroy(*collisionInfo.object);
-            }
-            return;
+            collisionInfo.pos.y = m_modelToWorld.t.y;
+            Particles::Spawn(ParticleEmitter::ImpactSparks, collisionInfo.pos, collisionInfo.normal, m_stepWorldSpace);
+        }
+        if((collisionObjectMask & kCollisionMaskEnemy) && (collisionInfo.object != nullptr))
+        {
+            // This is a poor separation of concerns.
+            // But it's a simple enough game - so meh.
+            EnemyTanks::Destroy(*collisionInfo.object);
         }
     }
 
-    void Draw(DisplayList& displayList, const Camera& camera) const
+    void Capture(DrawState& drawState) const
     {
-        GetFixedShape(FixedShape::Projectile).Draw(displayList, m_modelToWorld, camera, kIntensityAdjustment * 1.5f);
+        // Back up to between the last two ticks
+        FixedTransform3D modelToWorld = m_modelToWorld;
+        modelToWorld.t -= m_stepWorldSpace * (StandardFixedTranslationScalar(1.f) - Simulation::GetTickFraction());
+        drawState.PushShape(FixedShape::Projectile, modelToWorld, kIntensityAdjustment * 1.5f);
     }
 
     void Activate(const FixedTransform3D& parent, uint collisionMask)
@@ -97,6 +106,11 @@ private:
 
 static Projectile s_projectiles[kMaxProjectiles] = {};
 
+// Scratch space for Update's collision tests.
+// These grow with the number of tanks, so they're too big for the stack.
+static CollisionTester s_collisionTesters[kMaxProjectiles];
+static CollisionInfo   s_collisionInfos[kMaxProjectiles];
+static Projectile*     s_testedProjectiles[kMaxProjectiles];
 
 void Projectiles::Reset()
 {
@@ -108,17 +122,32 @@ void Projectiles::Reset()
 
 void Projectiles::Update()
 {
+    // Move all the projectiles, and then test them against the collision
+    // world together so it only gets traversed once
+    uint numTests = 0;
     for(Projectile& projectile : s_projectiles)
     {
-        if(projectile.IsActive()) projectile.Update();
+        if(projectile.IsActive() && projectile.Update())
+        {
+            s_collisionTesters[numTests] = projectile.GetCollisionTester();
+            s_testedProjectiles[numTests++] = &projectile;
+        }
+    }
+    if(Collisions::TestBatch(s_collisionTesters, numTests, false/*justDoCircles*/, s_collisionInfos) == 0)
+    {
+        return;
+    }
+    for(uint i = 0; i < numTests; ++i)
+    {
+        if(s_collisionInfos[i].mask != 0) s_testedProjectiles[i]->OnCollision(s_collisionInfos[i]);
     }
 }
 
-void Projectiles::Draw(DisplayList& displayList, const Camera& camera)
+void Projectiles::Capture(DrawState& drawState)
 {
     for(const Projectile& projectile : s_projectiles)
     {
-        if(projectile.IsActive()) projectile.Draw(displayList, camera);
+        if(projectile.IsActive()) projectile.Capture(drawState);
     }
 }
 
@@ -21,6 +21,12 @@
 #pragma once
 #include "picovectorscope.h"
 #include "extras/camera.h"
+#include "enemytanks.h"
+
+struct DrawState;
+
+// One for the player, and one for each enemy tank
+static constexpr int kMaxProjectiles = 1 + kMaxEnemyTanks;
 
 
 // Static class to manage _all_ the projectiles
@@ -29,7 +35,7 @@ class Projectiles
 public:    
     static void Reset();
     static void Update();
-    static void Draw(DisplayList& displayList, const Camera& camera);
+    static void Capture(DrawState& drawState);
 
     static bool IsActive(int idx);
     static void Create(int idx, const FixedTransform3D& parent, uint collisionMask);
@@ -21,6 +21,7 @@
 #include "radar.h"
 #include "spacetanks.h"
 #include "enemytanks.h"
+#include "drawstate.h"
 
 static constexpr Angle kRadarRotationStep = 1.f * k2Pi * (float) kPerSecondMultiplier;
 static constexpr DisplayListVector2 kRadarPos(0.15f, 0.85f);
@@ -38,7 +39,7 @@ static Angle s_radarAngle = 0;
 static StandardFixedTranslationScalar s_normRadarAngle = 0;
 LogChannel s_radarLog(true);
 
-static void drawPing(DisplayList& displayList, const FixedTransform3D& worldToView, const StandardFixedTranslationVector& pos)
+static void capturePing(DrawState& drawState, const FixedTransform3D& worldToView, const StandardFixedTranslationVector& pos)
 {
     StandardFixedTranslationVector localPos;
     worldToView.transformVector(localPos, pos);
@@ -55,7 +56,7 @@ static void drawPing(DisplayList& displayList, const FixedTransform3D& worldToVi
     }
     DisplayListVector2 screenPos(localPos.x * scale * kAspectRatio, localPos.z * scale);
     screenPos += kRadarPos;
-    displayList.PushPoint(screenPos, intensity);
+    drawState.PushScreenPoint(screenPos, intensity);
 }
 
 void Radar::Reset()
@@ -83,12 +84,28 @@ void Radar::Update()
     s_normRadarAngle = kRecip2Pi * s_radarAngle;
 }
 
-void Radar::Draw(DisplayList& displayList, const Camera& camera)
+void Radar::Capture(DrawState& drawState)
+{
+    drawState.radarAngle = s_radarAngle;
+
+    // Ping all the active enemy tanks
+    const FixedTransform3D& cameraToWorld = drawState.camera.GetCameraToWorld();
+    FixedTransform3D worldToCamera;
+    cameraToWorld.orthonormalInvert(worldToCamera);
+    const uint numTanks = EnemyTanks::GetNumActive();
+    for(uint i = 0; i < numTanks; ++i)
+    {
+        const FixedTransform3D* modelToWorld = EnemyTanks::GetTransformIfAlive(i);
+        if(modelToWorld) capturePing(drawState, worldToCamera, modelToWorld->t);
+    }
+}
+
+void Radar::Draw(DisplayList& displayList, const DrawState& drawState)
 {
     // Draw the radar sweep
     displayList.PushVector(kRadarPos, 0);
     SinTable::ValueType s, c;
-    SinTable::SinCos(s_radarAngle, s, c);
+    SinTable::SinCos(drawState.radarAngle, s, c);
     displayList.PushVector(-s * kRadarRadius * kAspectRatio + kRadarPos.x, c * -kRadarRadius + kRadarPos.y, 1);
 
     // Draw the circle
@@ -98,14 +115,10 @@ void Radar::Draw(DisplayList& displayList, const Camera& camera)
         displayList.PushVector(s_circlePoints[i], 0.5f);
     }
 
-
-    // Draw all the active enemy tanks
-    const FixedTransform3D& cameraToWorld = camera.GetCameraToWorld();
-    FixedTransform3D worldToCamera;
-    cameraToWorld.orthonormalInvert(worldToCamera);
-    for(int i = 0; i < kMaxEnemyTanks; ++i)
+    // Draw the pings
+    for(uint i = 0; i < drawState.numScreenPoints; ++i)
     {
-        const FixedTransform3D* modelToWorld = EnemyTanks::GetTransformIfAlive(i);
-        if(modelToWorld) drawPing(displayList, worldToCamera, modelToWorld->t);
+        const DrawStateScreenPoint& ping = drawState.screenPoints[i];
+        displayList.PushPoint(ping.pos, ping.intensity);
     }
 }
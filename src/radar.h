@@ -22,11 +22,14 @@
 #include "picovectorscope.h"
 #include "extras/camera.h"
 
+struct DrawState;
+
 // Static class for the radar
 class Radar
 {
 public:
     static void Reset();
     static void Update();
-    static void Draw(DisplayList& displayList, const Camera& camera);
+    static void Capture(DrawState& drawState);
+    static void Draw(DisplayList& displayList, const DrawState& drawState);
 };
\ No newline at end of file
@@ -0,0 +1,142 @@
+// Space Tanks simulation
+//
+//
+// Copyright (C) 2023 Oli Wright
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// A copy of the GNU General Public License can be found in the file
+// LICENSE.txt in the root of this project.
+// If not, see <https://www.gnu.org/licenses/>.
+//
+// oli.wright.github@gmail.com
+
+#include "simulation.h"
+#include "grid.h"
+#include "background.h"
+#include "collisions.h"
+#include "player.h"
+#include "obstacles.h"
+#include "enemytanks.h"
+#include "projectiles.h"
+#include "particles.h"
+#include "debris.h"
+#include "radar.h"
+#include "navigation.h"
+#include "lineofsight.h"
+#include "spawnpoints.h"
+#include "spacetanks.h"
+#include "drawstate.h"
+
+static constexpr uint kFrameRate = kFramesPerSecond.getIntegerPart();
+static constexpr uint kTickRate = kTicksPerSecond.getIntegerPart();
+
+// If we fall further behind than this, give up on catching up rather than
+// spending even longer on the next frame
+static constexpr uint kMaxTicksPerAdvance = 4 * ((kTickRate + kFrameRate - 1) / kFrameRate);
+
+// Ticks are due whenever this reaches kFrameRate.  Counting whole frames
+// like this keeps one tick per frame exact when the rates match.
+static uint s_tickAccumulator = 0;
+
+StandardFixedTranslationScalar Simulation::s_tickFraction = 1.f;
+
+void Simulation::Reset()
+{
+    Collisions::Reset();
+    Navigation::Reset();
+    LineOfSight::Reset();
+    Grid::Init();
+    Obstacles::Init();
+    SpawnPoints::Reset();
+    Player::Reset();
+    EnemyTanks::Reset();
+    Projectiles::Reset();
+    Particles::Reset();
+    Debris::Reset();
+    Radar::Reset();
+    s_tickAccumulator = 0;
+    s_tickFraction = 1.f;
+}
+
+void Simulation::Update()
+{
+    Collisions::HashDynamicObjects();
+    Player::Update();
+    Navigation::Update();
+    EnemyTanks::Update();
+    Projectiles::Update();
+    Particles::Update();
+    Debris::Update();
+    Radar::Update();
+    Collisions::EndProfileTick();
+}
+
+void Simulation::Advance(float dt)
+{
+    // Round to whole frames, so that a dropped frame is caught up on
+    uint numFrames = (uint) (dt * (float) kFrameRate + 0.5f);
+    if(numFrames == 0) numFrames = 1;
+    s_tickAccumulator += numFrames * kTickRate;
+
+    uint numTicks = 0;
+    while(s_tickAccumulator >= kFrameRate)
+    {
+        s_tickAccumulator -= kFrameRate;
+        if(numTicks < kMaxTicksPerAdvance)
+        {
+            Update();
+            ++numTicks;
+        }
+    }
+
+    if(kTickRate >= kFrameRate)
+    {
+        s_tickFraction = 1.f;
+    }
+    else
+    {
+        s_tickFraction = (float) s_tickAccumulator / (float) kFrameRate;
+    }
+}
+
+void Simulation::Capture(DrawState& drawState)
+{
+    drawState.Clear();
+    // The camera goes first, because the rest cull against it
+    Player::Capture(drawState);
+    EnemyTanks::Capture(drawState);
+    Projectiles::Capture(drawState);
+    Particles::Capture(drawState);
+    Debris::Capture(drawState);
+    Radar::Capture(drawState);
+}
+
+void Simulation::Draw(DisplayList& displayList, const DrawState& drawState)
+{
+    const Camera& camera = drawState.camera;
+
+    Player::Draw(displayList);
+    for(uint i = 0; i < drawState.numShapes; ++i)
+    {
+        const DrawStateShape& shape = drawState.shapes[i];
+        GetFixedShape(shape.shape).Draw(displayList, shape.modelToWorld, camera, shape.intensity);
+    }
+    for(uint i = 0; i < drawState.numPoints; ++i)
+    {
+        const DrawStatePoint& point = drawState.points[i];
+        Shape3D::DrawPoint(displayList, point.pos, camera, point.intensity);
+    }
+    Obstacles::Draw(displayList, camera);
+    Grid::Draw(displayList, camera);
+    Background::Draw(displayList, camera);
+    Radar::Draw(displayList, drawState);
+}
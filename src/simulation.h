@@ -0,0 +1,52 @@
+// Space Tanks simulation
+//
+//
+// Copyright (C) 2023 Oli Wright
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// A copy of the GNU General Public License can be found in the file
+// LICENSE.txt in the root of this project.
+// If not, see <https://www.gnu.org/licenses/>.
+//
+// oli.wright.github@gmail.com
+
+#pragma once
+#include "picovectorscope.h"
+
+struct DrawState;
+
+// Static class to run the whole game.
+// This is kept apart from the Demo so that it can also run headless on the host.
+class Simulation
+{
+public:
+    static void Reset();
+
+    // Run a single tick
+    static void Update();
+
+    // Run however many ticks are due after dt seconds' worth of frames
+    static void Advance(float dt);
+
+    // Take everything that drawing needs from where the simulation is now
+    static void Capture(DrawState& drawState);
+
+    // Only reads from drawState, so this can run alongside the next Advance
+    static void Draw(DisplayList& displayList, const DrawState& drawState);
+
+    // How far drawing is between the previous tick and the latest one.
+    // This is always 1 when ticks are at least as frequent as frames.
+    static StandardFixedTranslationScalar GetTickFraction() { return s_tickFraction; }
+
+private:
+    static StandardFixedTranslationScalar s_tickFraction;
+};
@@ -19,19 +19,13 @@
 // oli.wright.github@gmail.com
 
 #include "picovectorscope.h"
-#include "extras/shapes3d.h"
 
 #include "spacetanks.h"
-#include "shapes.h"
-#include "grid.h"
-#include "background.h"
-#include "collisions.h"
-#include "player.h"
-#include "obstacles.h"
-#include "enemytanks.h"
-#include "projectiles.h"
-#include "particles.h"
-#include "radar.h"
+#include "simulation.h"
+#include "drawstate.h"
+#if SPACETANKS_PIPELINE
+#    include "pipeline.h"
+#endif
 
 static LogChannel s_spaceTanksLog(false);
 
@@ -42,33 +36,31 @@ public:
     void UpdateAndRender(DisplayList& displayList, float dt);
     void Start()
     {
-        Collisions::Reset();
-        Grid::Init();
-        Obstacles::Init();
-        Player::Reset();
-        EnemyTanks::Reset();
-        Projectiles::Reset();
-        Particles::Reset();
-        Radar::Reset();
+#if SPACETANKS_PIPELINE
+        // The other core mustn't be simulating while we reset
+        Pipeline::Stop();
+        Simulation::Reset();
+        Pipeline::Start();
+#else
+        Simulation::Reset();
+#endif
     }
 };
 static SpaceTanks s_spaceTanks;
 
+#if !SPACETANKS_PIPELINE
+static DrawState s_drawState;
+#endif
+
 void SpaceTanks::UpdateAndRender(DisplayList& displayList, float dt)
 {
-    Player::Update();
-    EnemyTanks::Update();
-    Projectiles::Update();
-    Particles::Update();
-    Radar::Update();
-    const Camera& camera = Player::GetCamera();
-
-    Player::Draw(displayList);
-    EnemyTanks::Draw(displayList, camera);
-    Projectiles::Draw(displayList, camera);
-    Particles::Draw(displayList, camera);
-    Obstacles::Draw(displayList, camera);
-    Grid::Draw(displayList, camera);
-    Background::Draw(displayList, camera);
-    Radar::Draw(displayList, camera);
+#if SPACETANKS_PIPELINE
+    // The other core is simulating the next frame while we draw this one
+    Simulation::Draw(displayList, Pipeline::BeginDraw());
+    Pipeline::EndDraw(dt);
+#else
+    Simulation::Advance(dt);
+    Simulation::Capture(s_drawState);
+    Simulation::Draw(displayList, s_drawState);
+#endif
 }
@@ -26,10 +26,24 @@ typedef FixedPoint<8, 8, int32_t, int32_t> FrameRateValue;
 typedef FixedPoint<4, 16, int32_t, int32_t, false> Angle;
 
 // The frame rate to run at
-static constexpr FrameRateValue kFramesPerSecond = 240;
+static constexpr FrameRateValue kFramesPerSecond = 240.f;
 
-// Convert from something per second to something per frame
-static constexpr FrameRateValue kPerSecondMultiplier = 1.f / (float) kFramesPerSecond;
+// The rate the simulation ticks at.
+// This doesn't have to match the frame rate.  When it's lower, drawing
+// interpolates between the last two ticks.
+// This can be overridden by the build.
+#ifndef SPACETANKS_TICKS_PER_SECOND
+#    define SPACETANKS_TICKS_PER_SECOND 240
+#endif
+static constexpr FrameRateValue kTicksPerSecond = (float) SPACETANKS_TICKS_PER_SECOND;
+
+// Convert from something per second to something per tick
+static constexpr FrameRateValue kPerSecondMultiplier = 1.f / (float) kTicksPerSecond;
+
+// Convert from something per second per second, like an acceleration, to
+// something per tick per tick.
+// This is too small for a FrameRateValue, so it's a float for building constants.
+static constexpr float kPerSecondSquaredMultiplier = (float) kPerSecondMultiplier * (float) kPerSecondMultiplier;
 
 // Adjustment to try to keep intensities uniform across different frame rates
 // TODO: Make this better.  It doesn't account for intensity non-linearity.
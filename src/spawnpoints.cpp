@@ -0,0 +1,127 @@
+// Space Tanks spawn points
+//
+//
+// Copyright (C) 2023 Oli Wright
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// A copy of the GNU General Public License can be found in the file
+// LICENSE.txt in the root of this project.
+// If not, see <https://www.gnu.org/licenses/>.
+//
+// oli.wright.github@gmail.com
+
+#include "spawnpoints.h"
+#include "navigation.h"
+#include "player.h"
+
+// The lattice of candidates, kSpawnLatticeSpacing apart across ±16 units
+static constexpr uint kSpawnLatticeSize = 17;
+static constexpr float kSpawnLatticeSpacing = 2.f;
+static constexpr float kSpawnLatticeMin = -16.f;
+static constexpr uint kMaxSpawnCandidates = kSpawnLatticeSize * kSpawnLatticeSize;
+
+// How many candidates Pick looks at before settling for the best so far
+static constexpr uint kNumCandidatesToTry = 16;
+// Step through the candidates by this much, so the ones tried are spread out
+static constexpr uint kCandidateStride = 37;
+
+// No closer to the player than this
+static constexpr StandardFixedTranslationScalar kMinPlayerDistance = 6.f;
+static constexpr StandardFixedTranslationScalar kMinPlayerDistanceSquared = kMinPlayerDistance * kMinPlayerDistance;
+
+struct SpawnLatticeCoords
+{
+    StandardFixedTranslationScalar coords[kSpawnLatticeSize];
+};
+
+static constexpr SpawnLatticeCoords makeSpawnLatticeCoords()
+{
+    SpawnLatticeCoords latticeCoords = {};
+    for(uint i = 0; i < kSpawnLatticeSize; ++i)
+    {
+        latticeCoords.coords[i] = kSpawnLatticeMin + ((float) i * kSpawnLatticeSpacing);
+    }
+    return latticeCoords;
+}
+static constexpr SpawnLatticeCoords kSpawnLatticeCoords = makeSpawnLatticeCoords();
+
+// Each candidate is its x and z lattice indices, packed into a byte each
+static uint16_t s_candidates[kMaxSpawnCandidates];
+static uint     s_numCandidates = 0;
+
+LogChannel s_spawnPointsLog(false);
+
+static StandardFixedTranslationVector getCandidatePos(uint candidateIdx)
+{
+    const uint16_t candidate = s_candidates[candidateIdx];
+    return StandardFixedTranslationVector(kSpawnLatticeCoords.coords[candidate & 0xff],
+                                          0,
+                                          kSpawnLatticeCoords.coords[candidate >> 8]);
+}
+
+void SpawnPoints::Reset()
+{
+    s_numCandidates = 0;
+    for(uint z = 0; z < kSpawnLatticeSize; ++z)
+    {
+        for(uint x = 0; x < kSpawnLatticeSize; ++x)
+        {
+            const StandardFixedTranslationVector pos(kSpawnLatticeCoords.coords[x], 0, kSpawnLatticeCoords.coords[z]);
+            if(!Navigation::IsBlocked(pos))
+            {
+                s_candidates[s_numCandidates++] = (uint16_t) (x | (z << 8));
+            }
+        }
+    }
+    assert(s_numCandidates > 0);
+    LOG_INFO(s_spawnPointsLog, "%u spawn candidates\n", s_numCandidates);
+}
+
+StandardFixedTranslationVector SpawnPoints::Pick()
+{
+    const StandardFixedTranslationVector& playerPos = Player::GetPosition();
+    const StandardFixedOrientationVector& playerForward = Player::GetForward();
+
+    // Start somewhere random, and prefer far enough away and out of view,
+    // then just far enough away, then whichever was furthest
+    uint candidateIdx = (uint) (StandardFixedTranslationScalar::randZeroToOne() * (int) s_numCandidates);
+    if(candidateIdx >= s_numCandidates) candidateIdx = 0;
+    uint bestIdx = candidateIdx;
+    uint bestScore = 0;
+    StandardFixedTranslationScalar furthestDistanceSquared = 0;
+    for(uint i = 0; i < kNumCandidatesToTry; ++i)
+    {
+        const StandardFixedTranslationVector relPos = getCandidatePos(candidateIdx) - playerPos;
+        const StandardFixedTranslationScalar distanceSquared = (relPos.x * relPos.x) + (relPos.z * relPos.z);
+        uint score = 0;
+        if(distanceSquared >= kMinPlayerDistanceSquared)
+        {
+            // In view is in front, and within the field of view either side
+            const StandardFixedTranslationScalar depth = (relPos.x * playerForward.x) + (relPos.z * playerForward.z);
+            const StandardFixedTranslationScalar across = (relPos.x * playerForward.z) - (relPos.z * playerForward.x);
+            const bool inView = (depth > 0) && (Abs(across) < (depth * Player::kTanHalfFOV));
+            score = inView ? 1 : 2;
+        }
+        if((score > bestScore) || ((score == bestScore) && (distanceSquared > furthestDistanceSquared)))
+        {
+            bestIdx = candidateIdx;
+            bestScore = score;
+            furthestDistanceSquared = distanceSquared;
+            if(score == 2)
+            {
+                break;
+            }
+        }
+        candidateIdx = (candidateIdx + kCandidateStride) % s_numCandidates;
+    }
+    return getCandidatePos(bestIdx);
+}
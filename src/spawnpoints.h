@@ -0,0 +1,38 @@
+// Space Tanks spawn points
+//
+//
+// Copyright (C) 2023 Oli Wright
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// A copy of the GNU General Public License can be found in the file
+// LICENSE.txt in the root of this project.
+// If not, see <https://www.gnu.org/licenses/>.
+//
+// oli.wright.github@gmail.com
+
+#pragma once
+#include "picovectorscope.h"
+
+// Static class for picking where enemy tanks appear.
+// The candidates are a lattice over the middle of the arena, with any that
+// are blocked by obstacles thrown out at Reset.  Picking only looks at a
+// few of them, so it takes the same time however many tanks respawn at once.
+class SpawnPoints
+{
+public:
+    // The obstacles must already be set up
+    static void Reset();
+
+    // Pick somewhere on the ground, away from the player, and out of their
+    // view if possible.  This always finds somewhere.
+    static StandardFixedTranslationVector Pick();
+};
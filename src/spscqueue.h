@@ -0,0 +1,74 @@
+// Space Tanks single producer, single consumer queue
+//
+//
+// Copyright (C) 2023 Oli Wright
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// A copy of the GNU General Public License can be found in the file
+// LICENSE.txt in the root of this project.
+// If not, see <https://www.gnu.org/licenses/>.
+//
+// oli.wright.github@gmail.com
+
+#pragma once
+#include "picovectorscope.h"
+#include <atomic>
+
+// A lock-free queue for passing things from one core to another.
+// Exactly one core may Push, and exactly one other core may Pop.
+// N must be a power of 2.
+template<typename T, uint N>
+class SpscQueue
+{
+public:
+    static_assert((N & (N - 1)) == 0, "");
+
+    // Only call this when neither side is using the queue
+    void Reset()
+    {
+        m_head.store(0, std::memory_order_relaxed);
+        m_tail.store(0, std::memory_order_relaxed);
+    }
+
+    // Returns false if the queue is full
+    bool Push(const T& item)
+    {
+        const uint tail = m_tail.load(std::memory_order_relaxed);
+        if((tail - m_head.load(std::memory_order_acquire)) == N)
+        {
+            return false;
+        }
+        m_items[tail & (N - 1)] = item;
+        // Publish the item before the new tail
+        m_tail.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Returns false if the queue is empty
+    bool Pop(T& item)
+    {
+        const uint head = m_head.load(std::memory_order_relaxed);
+        if(head == m_tail.load(std::memory_order_acquire))
+        {
+            return false;
+        }
+        item = m_items[head & (N - 1)];
+        // Only free the slot once we've read it
+        m_head.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+private:
+    T                 m_items[N];
+    std::atomic<uint> m_head{0}; //< Only written by the consumer
+    std::atomic<uint> m_tail{0}; //< Only written by the producer
+};